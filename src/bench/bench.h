@@ -0,0 +1,217 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+// Shared harness of the engine benchmarks.  Every case (engine, variant,
+// grain count, thread count) runs in a forked child, so its peak RSS is its
+// own, with warmup runs first and then timed repeats.  Results are appended
+// to a .csv or .jsonl file in the same schema bench_cython.py writes.
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+struct bench_config {
+    std::vector<int> log2_grains;
+    std::vector<int> threads = {1};
+    std::vector<std::string> variants;
+    int warmup = 1;
+    int repeats = 3;
+    std::string output = "bench.csv";
+};
+
+// what one run of a case reports back; seconds covers the stabilizer only,
+// not building the pile
+struct run_stats {
+    double seconds;
+    long long sweeps;
+    double topples;
+};
+
+struct bench_result {
+    std::string engine;
+    std::string variant;
+    unsigned long long grains;
+    int width;
+    int threads;
+    int repeats;
+    double wall_min;
+    double wall_mean;
+    double wall_max;
+    long long sweeps;
+    double topples;
+    long peak_rss_kb;
+};
+
+// width that holds a stable pile of the given size with a small margin,
+// the outer radius grid.py uses: the density never drops below 2
+inline int width_for(unsigned long long grains) {
+    return std::sqrt(grains / (2 * M_PI)) + 4;
+}
+
+static std::vector<int> parse_list(const std::string &text) {
+    std::vector<int> values;
+    std::stringstream stream(text);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        values.push_back(std::atoi(item.c_str()));
+    }
+    return values;
+}
+
+// lo:hi[:step] exponents of two, or a comma separated list of exponents
+static std::vector<int> parse_range(const std::string &text) {
+    if (text.find(':') == std::string::npos) return parse_list(text);
+    std::vector<int> bounds;
+    std::stringstream stream(text);
+    std::string item;
+    while (std::getline(stream, item, ':')) {
+        bounds.push_back(std::atoi(item.c_str()));
+    }
+    int step = bounds.size() > 2 ? std::max(bounds[2], 1) : 1;
+    std::vector<int> values;
+    for (int k = bounds[0]; k <= bounds[1]; k += step) values.push_back(k);
+    return values;
+}
+
+inline bool parse_bench_args(int argc, char **argv, bench_config &config,
+                             const std::vector<std::string> &all_variants) {
+    config.log2_grains = parse_range("10:26:2");
+    config.variants = all_variants;
+    for (int k = 1; k < argc; k += 2) {
+        std::string name = argv[k];
+        std::string value = k + 1 < argc ? argv[k+1] : "";
+        if (value.empty()) name.clear();
+        if (name == "--grains") config.log2_grains = parse_range(value);
+        else if (name == "--threads") config.threads = parse_list(value);
+        else if (name == "--warmup") config.warmup = std::atoi(value.c_str());
+        else if (name == "--repeats") config.repeats = std::atoi(value.c_str());
+        else if (name == "--output") config.output = value;
+        else if (name == "--variants") {
+            config.variants.clear();
+            std::stringstream stream(value);
+            std::string item;
+            while (std::getline(stream, item, ',')) config.variants.push_back(item);
+        } else {
+            name.clear();
+        }
+        if (name.empty()) {
+            std::cerr << "usage: " << argv[0] << " [--grains lo:hi[:step]]"
+                      << " [--threads 1,2,4] [--variants a,b] [--warmup N]"
+                      << " [--repeats N] [--output file.csv|file.jsonl]"
+                      << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// times f, the stabilizer call of a case
+template <typename F>
+inline double seconds_of(F f) {
+    auto t1 = std::chrono::steady_clock::now();
+    f();
+    auto t2 = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(t2 - t1).count();
+}
+
+// Runs warmup + repeats calls of run_once in a child process.  The child
+// sends its timings back through a pipe, the parent fills in the rest.
+inline bool measure(bench_result &result, int warmup, int repeats,
+                    std::function<run_stats()> run_once) {
+    int fd[2];
+    if (pipe(fd) != 0) return false;
+    std::cout.flush();
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(fd[0]);
+        // engines chat on stdout, keep it out of the bench output
+        if (std::freopen("/dev/null", "w", stdout) == nullptr) _exit(1);
+        double walls[3] = {1e300, 0, 0};
+        run_stats stats = {0, 0, 0};
+        for (int k = 0; k < warmup + repeats; k++) {
+            stats = run_once();
+            double wall = stats.seconds;
+            if (k < warmup) continue;
+            walls[0] = std::min(walls[0], wall);
+            walls[1] += wall / repeats;
+            walls[2] = std::max(walls[2], wall);
+        }
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        double message[6] = {walls[0], walls[1], walls[2],
+                             double(stats.sweeps), stats.topples,
+                             double(usage.ru_maxrss)};
+        ssize_t written = write(fd[1], message, sizeof(message));
+        _exit(written == sizeof(message) ? 0 : 1);
+    }
+    close(fd[1]);
+    double message[6];
+    ssize_t got = read(fd[0], message, sizeof(message));
+    close(fd[0]);
+    int status;
+    waitpid(pid, &status, 0);
+    if (got != sizeof(message) or not WIFEXITED(status) or
+        WEXITSTATUS(status) != 0) {
+        return false;
+    }
+    result.repeats = repeats;
+    result.wall_min = message[0];
+    result.wall_mean = message[1];
+    result.wall_max = message[2];
+    result.sweeps = message[3];
+    result.topples = message[4];
+    result.peak_rss_kb = message[5];
+    return true;
+}
+
+inline void write_result(const bench_result &r, const std::string &output) {
+    bool json = output.size() > 6 and
+                output.compare(output.size() - 6, 6, ".jsonl") == 0;
+    std::ifstream existing(output);
+    bool fresh = existing.peek() == std::ifstream::traits_type::eof();
+    existing.close();
+    std::ofstream out(output, std::ios::app);
+    double rate = r.wall_mean > 0 ? r.topples / r.wall_mean : 0;
+    if (json) {
+        out << "{\"engine\": \"" << r.engine << "\", \"variant\": \""
+            << r.variant << "\", \"grains\": " << r.grains
+            << ", \"width\": " << r.width << ", \"threads\": " << r.threads
+            << ", \"repeats\": " << r.repeats
+            << ", \"wall_min\": " << r.wall_min
+            << ", \"wall_mean\": " << r.wall_mean
+            << ", \"wall_max\": " << r.wall_max
+            << ", \"sweeps\": " << r.sweeps
+            << ", \"topples\": " << r.topples
+            << ", \"topples_per_sec\": " << rate
+            << ", \"peak_rss_kb\": " << r.peak_rss_kb << "}\n";
+    } else {
+        if (fresh) {
+            out << "engine,variant,grains,width,threads,repeats,wall_min,"
+                   "wall_mean,wall_max,sweeps,topples,topples_per_sec,"
+                   "peak_rss_kb\n";
+        }
+        out << r.engine << "," << r.variant << "," << r.grains << ","
+            << r.width << "," << r.threads << "," << r.repeats << ","
+            << r.wall_min << "," << r.wall_mean << "," << r.wall_max << ","
+            << r.sweeps << "," << r.topples << "," << rate << ","
+            << r.peak_rss_kb << "\n";
+    }
+    std::cerr << r.engine << " " << r.variant << " 2^"
+              << std::log2(double(r.grains)) << " grains, " << r.threads
+              << " threads: " << r.wall_mean << " s, " << rate
+              << " topples/s, " << r.peak_rss_kb << " kB" << std::endl;
+}
+
+#endif
@@ -0,0 +1,157 @@
+'''
+Benchmark of the Cython _stabilize kernel on the octant folded square
+lattice of grid.py, writing the same records as bench_grid and bench_nodes.
+
+Build the extension in src/python first (python setup.py build_ext
+--inplace).  Variant folded is the single threaded kernel, so --threads
+only applies to colored, which topples greedy color classes in parallel.
+'''
+import argparse
+import csv
+import json
+import multiprocessing
+import os
+import resource
+import sys
+import time
+
+import numpy as np
+
+sys.path.insert(0, os.path.join(os.path.dirname(__file__), '..', 'python'))
+
+FIELDS = [
+    'engine', 'variant', 'grains', 'width', 'threads', 'repeats',
+    'wall_min', 'wall_mean', 'wall_max', 'sweeps', 'topples',
+    'topples_per_sec', 'peak_rss_kb',
+]
+
+
+def width_for(grains):
+    # same margin as bench.h: the radius the pile would have at density 2
+    return int(np.sqrt(grains / (2 * np.pi))) + 4
+
+
+def parse_range(text):
+    if ':' not in text:
+        return [int(k) for k in text.split(',')]
+    bounds = [int(k) for k in text.split(':')]
+    step = max(bounds[2], 1) if len(bounds) > 2 else 1
+    return list(range(bounds[0], bounds[1] + 1, step))
+
+
+def run_case(grains, variant, threads, warmup, repeats, connection):
+    from grid import RectGrid, greedy_coloring, color_classes
+    from stabilize import _stabilize, _stabilize_colored
+
+    width = width_for(grains)
+    grid = RectGrid(2 * width - 1, 2)
+    expand, collapse, mask = grid.expand_collapse_ops()
+    laplacian = (collapse @ grid.laplacian @ expand).tocsc()
+    laplacian.setdiag(0, k=0)
+    laplacian.eliminate_zeros()
+    data = laplacian.data.astype(np.int8)
+    indices = laplacian.indices.astype(np.int32)
+    indptr = laplacian.indptr.astype(np.int32)
+    seed = np.zeros(grid.r.shape, dtype=np.int64)
+    seed[grid.r == 0] = grains
+    seed = collapse @ seed
+    if variant == 'colored':
+        # the colored kernel pulls along rows
+        rows = laplacian.tocsr()
+        data = rows.data.astype(np.int8)
+        indices = rows.indices.astype(np.int32)
+        indptr = rows.indptr.astype(np.int32)
+        order, color_ptr = color_classes(greedy_coloring(laplacian))
+
+    walls = []
+    for k in range(warmup + repeats):
+        pile = seed.astype(np.int64)
+        t0 = time.perf_counter()
+        if variant == 'colored':
+            sweeps = _stabilize_colored(pile, data, indices, indptr, order,
+                                        color_ptr, num_threads=threads)
+        else:
+            sweeps = _stabilize(pile, data, indices, indptr)
+        t1 = time.perf_counter()
+        if k >= warmup:
+            walls.append(t1 - t0)
+    # every plane toppling moves sum(|x|^2) of the pile up by exactly 4
+    topples = float(np.sum(grid.r ** 2 * (expand @ pile))) / 4
+    connection.send({
+        'width': width,
+        'wall_min': min(walls),
+        'wall_mean': sum(walls) / len(walls),
+        'wall_max': max(walls),
+        'sweeps': sweeps,
+        'topples': topples,
+        'peak_rss_kb': resource.getrusage(resource.RUSAGE_SELF).ru_maxrss,
+    })
+
+
+def measure(grains, variant, threads, warmup, repeats):
+    # a fresh process per case, so peak RSS belongs to that case alone
+    context = multiprocessing.get_context('fork')
+    receiver, sender = context.Pipe(duplex=False)
+    process = context.Process(
+        target=run_case, args=(grains, variant, threads, warmup, repeats, sender)
+    )
+    process.start()
+    sender.close()
+    try:
+        stats = receiver.recv()
+    except EOFError:
+        stats = None
+    process.join()
+    return stats
+
+
+def write_result(result, output):
+    fresh = not os.path.exists(output) or os.path.getsize(output) == 0
+    with open(output, 'a') as f:
+        if output.endswith('.jsonl'):
+            f.write(json.dumps(result) + '\n')
+        else:
+            writer = csv.DictWriter(f, fieldnames=FIELDS)
+            if fresh:
+                writer.writeheader()
+            writer.writerow(result)
+    print('cython {variant} 2^{log2:g} grains: {wall_mean} s, '
+          '{topples_per_sec:g} topples/s, {peak_rss_kb} kB'.format(
+              log2=np.log2(result['grains']), **result), file=sys.stderr)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument('--grains', default='10:26:2',
+                        help='lo:hi[:step] or a list of exponents of two')
+    parser.add_argument('--threads', default='1')
+    parser.add_argument('--variants', default='folded,colored')
+    parser.add_argument('--warmup', type=int, default=1)
+    parser.add_argument('--repeats', type=int, default=3)
+    parser.add_argument('--output', default='bench.csv')
+    args = parser.parse_args()
+
+    for variant in args.variants.split(','):
+        if variant not in ('folded', 'colored'):
+            print('skipping variant ' + variant, file=sys.stderr)
+            continue
+        threads = parse_range(args.threads) if variant == 'colored' else [1]
+        for k in parse_range(args.grains):
+            for n in threads:
+                stats = measure(2 ** k, variant, n, args.warmup, args.repeats)
+                if stats is None:
+                    print('run failed: {} 2^{}'.format(variant, k), file=sys.stderr)
+                    continue
+                result = dict(
+                    engine='cython', variant=variant, grains=2 ** k,
+                    threads=n, repeats=args.repeats, **stats
+                )
+                result['topples_per_sec'] = (
+                    result['topples'] / result['wall_mean']
+                    if result['wall_mean'] > 0 else 0
+                )
+                write_result({key: result[key] for key in FIELDS}, args.output)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,100 @@
+#include "bench.h"
+#include "../grid/pile.h"
+#include "../grid/kernel.h"
+#include "../grid/compact.h"
+
+// Grid engine over the sweep.  A variant is engine[/kernel], engine chain,
+// bands, tiles, processes or compact and kernel as for sandpile --kernel.
+
+// plane topplings: every one moves sum(|x|^2) of the pile up by exactly 4
+template <typename F>
+static double topples(int width, F height) {
+    double moment = 0;
+    for (int i = 0; i < width; i++) {
+        for (int j = 0; j < width - i; j++) {
+            double multiplicity = (i == 0 and j == 0) ? 1 :
+                                  (i == 0 or j == 0) ? 4 : 8;
+            double x = j;
+            double y = i + j;
+            moment += multiplicity * (x*x + y*y) * height(i, j);
+        }
+    }
+    return moment / 4;
+}
+
+int main(int argc, char **argv) {
+    bench_config config;
+    if (not parse_bench_args(argc, argv, config, {"chain", "bands", "tiles", "processes", "compact"})) return 1;
+
+    for (const std::string &variant : config.variants) {
+        std::string engine = variant.substr(0, variant.find('/'));
+        std::string kernel = variant.find('/') == std::string::npos ?
+                             "auto" : variant.substr(variant.find('/') + 1);
+        if (kernel_by_name(kernel) == nullptr or
+            (engine != "chain" and engine != "bands" and engine != "tiles" and
+             engine != "processes" and engine != "compact")) {
+            std::cerr << "skipping variant " << variant << std::endl;
+            continue;
+        }
+        for (int k : config.log2_grains) {
+            for (int threads : config.threads) {
+                bench_result result;
+                result.engine = "grid";
+                result.variant = variant;
+                result.grains = 1ull << k;
+                result.width = width_for(result.grains);
+                result.threads = threads;
+                if (engine == "compact") {
+                    // single threaded, measured once
+                    if (threads != config.threads[0]) continue;
+                    result.threads = 1;
+                }
+                bool ok = measure(result, config.warmup, config.repeats, [&]() {
+                    run_stats stats;
+                    if (engine == "compact") {
+                        compact_pile sandpile(result.width);
+                        sandpile.kernel = kernel_by_name(kernel);
+                        sandpile.cells.set(0, 0, result.grains);
+                        stats.seconds = seconds_of([&]() {
+                            stats.sweeps = sandpile.stabilize();
+                        });
+                        stats.topples = topples(result.width, [&](int i, int j) {
+                            return sandpile.cells.get(i, j);
+                        });
+                        return stats;
+                    }
+                    pile sandpile(result.width);
+                    sandpile.kernel = kernel_by_name(kernel);
+                    sandpile.add_grains(result.grains);
+                    if (engine == "bands") {
+                        ThreadPool pool(threads);
+                        stats.seconds = seconds_of([&]() {
+                            stats.sweeps = sandpile.stabilize_bands(pool);
+                        });
+                    } else if (engine == "tiles") {
+                        // sweeps here are tiles relaxed
+                        ThreadPool pool(threads);
+                        stats.seconds = seconds_of([&]() {
+                            stats.sweeps = sandpile.stabilize_tiles(pool);
+                        });
+                    } else if (engine == "processes") {
+                        stats.seconds = seconds_of([&]() {
+                            stats.sweeps = sandpile.stabilize_processes(threads);
+                        });
+                    } else {
+                        stats.seconds = seconds_of([&]() {
+                            stats.sweeps = sandpile.stabilize(threads);
+                        });
+                    }
+                    stats.topples = topples(result.width, [&](int i, int j) {
+                        return sandpile.nodes(i, j);
+                    });
+                    return stats;
+                });
+                if (ok) write_result(result, config.output);
+                else std::cerr << "run failed: " << variant << " 2^" << k << std::endl;
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,51 @@
+#include "bench.h"
+#include "../nodes/pile.h"
+
+// Node engine over the sweep, variants plain and chaining.  Both are single
+// threaded, so --threads is ignored.
+
+// plane topplings: every one moves sum(|x|^2) of the pile up by exactly 4
+static double topples(pile &sandpile) {
+  double moment = 0;
+  for (int i = 0; i < sandpile.N; i++) {
+    for (int j = 0; j <= i; j++) {
+      double multiplicity = (i == 0) ? 1 : (j == 0 || j == i) ? 4 : 8;
+      moment += multiplicity * (i*i + j*j) * sandpile.height(i, j);
+    }
+  }
+  return moment / 4;
+}
+
+int main(int argc, char **argv) {
+  bench_config config;
+  if (!parse_bench_args(argc, argv, config, {"plain", "chaining"})) return 1;
+
+  for (const std::string &variant : config.variants) {
+    if (variant != "plain" && variant != "chaining") {
+      std::cerr << "skipping variant " << variant << std::endl;
+      continue;
+    }
+    for (int k : config.log2_grains) {
+      bench_result result;
+      result.engine = "nodes";
+      result.variant = variant;
+      result.grains = 1ull << k;
+      result.width = width_for(result.grains);
+      result.threads = 1;
+      bool ok = measure(result, config.warmup, config.repeats, [&]() {
+        pile sandpile(result.width);
+        sandpile.height(0, 0) = result.grains;
+        run_stats stats;
+        stats.seconds = seconds_of([&]() {
+          stats.sweeps = variant == "plain" ? sandpile.stabilize()
+                                            : sandpile.stabilizeWithChaining();
+        });
+        stats.topples = topples(sandpile);
+        return stats;
+      });
+      if (ok) write_result(result, config.output);
+      else std::cerr << "run failed: " << variant << " 2^" << k << std::endl;
+    }
+  }
+  return 0;
+}
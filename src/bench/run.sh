@@ -0,0 +1,15 @@
+#!/bin/sh
+# Builds the benchmarks and runs the whole sweep into one results file.
+# Extra arguments go to every benchmark, e.g.
+#   ./run.sh --grains 10:20:2 --threads 1,2,4 --output results.jsonl
+set -e
+cd "$(dirname "$0")"
+g++ -O2 -std=c++17 -pthread bench_grid.cpp ../grid/pile.cpp ../grid/tiles.cpp ../grid/procs.cpp ../grid/octant.cpp ../grid/kernel.cpp ../grid/pool.cpp ../grid/telemetry.cpp ../grid/snapshot.cpp ../grid/frames.cpp ../grid/render.cpp ../grid/profile.cpp ../grid/sliced.cpp ../grid/compact.cpp -o bench_grid
+g++ -O2 -std=c++17 bench_nodes.cpp ../nodes/pile.cpp -o bench_nodes
+./bench_grid "$@"
+./bench_nodes "$@"
+if (cd ../python && python3 -c "import stabilize" 2>/dev/null); then
+    python3 bench_cython.py "$@"
+else
+    echo "skipping cython benchmark, build src/python first" >&2
+fi
@@ -3,6 +3,7 @@
 
 #include <mutex>
 #include <condition_variable>
+#include <pthread.h>
  
 class ThreadGate {
 private:
@@ -59,4 +60,99 @@ public:
     } 
 };
 
+// All num_threads workers call arrive_and_wait once per phase.  Nobody
+// leaves a phase until everybody has arrived, and every worker gets back
+// true only if every worker arrived with done == true, which doubles as the
+// termination vote of the band stabilizer.
+class PhaseBarrier {
+private:
+    std::mutex mutex;
+    std::condition_variable pool_cv;
+    std::size_t phase;
+    std::size_t counter;
+    std::size_t thread_count;
+    bool all_done;
+    bool last_vote;
+public:
+    explicit PhaseBarrier(std::size_t num_threads) :
+        phase(0),
+        counter(num_threads),
+        thread_count(num_threads),
+        all_done(true),
+        last_vote(true) { }
+    bool arrive_and_wait(bool done)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        std::size_t arrival_phase = phase;
+        all_done &= done;
+        if (--counter == 0) {
+            last_vote = all_done;
+            all_done = true;
+            counter = thread_count;
+            phase++;
+            pool_cv.notify_all();
+        } else {
+            pool_cv.wait(lock, [this, arrival_phase] { return phase != arrival_phase; });
+        }
+        return last_vote;
+    }
+};
+
+// PhaseBarrier for workers in separate processes.  It lives in memory the
+// processes share, so it is built with placement new before they fork and
+// its mutex and condition are marked process shared.  Like its model it
+// doubles as the termination vote.
+class ProcessBarrier {
+private:
+    pthread_mutex_t mutex;
+    pthread_cond_t pool_cv;
+    std::size_t phase;
+    std::size_t counter;
+    std::size_t process_count;
+    bool all_done;
+    bool last_vote;
+public:
+    explicit ProcessBarrier(std::size_t num_processes) :
+        phase(0),
+        counter(num_processes),
+        process_count(num_processes),
+        all_done(true),
+        last_vote(true) {
+        pthread_mutexattr_t mutex_attr;
+        pthread_mutexattr_init(&mutex_attr);
+        pthread_mutexattr_setpshared(&mutex_attr, PTHREAD_PROCESS_SHARED);
+        pthread_mutex_init(&mutex, &mutex_attr);
+        pthread_mutexattr_destroy(&mutex_attr);
+        pthread_condattr_t cond_attr;
+        pthread_condattr_init(&cond_attr);
+        pthread_condattr_setpshared(&cond_attr, PTHREAD_PROCESS_SHARED);
+        pthread_cond_init(&pool_cv, &cond_attr);
+        pthread_condattr_destroy(&cond_attr);
+    }
+    ~ProcessBarrier() {
+        pthread_cond_destroy(&pool_cv);
+        pthread_mutex_destroy(&mutex);
+    }
+    ProcessBarrier(const ProcessBarrier &) = delete;
+    ProcessBarrier &operator=(const ProcessBarrier &) = delete;
+    bool arrive_and_wait(bool done)
+    {
+        pthread_mutex_lock(&mutex);
+        std::size_t arrival_phase = phase;
+        all_done &= done;
+        if (--counter == 0) {
+            last_vote = all_done;
+            all_done = true;
+            counter = process_count;
+            phase++;
+            pthread_cond_broadcast(&pool_cv);
+        } else {
+            while (phase == arrival_phase) pthread_cond_wait(&pool_cv, &mutex);
+        }
+        bool vote = last_vote;
+        pthread_mutex_unlock(&mutex);
+        return vote;
+    }
+};
+
 #endif
@@ -0,0 +1,202 @@
+#include "compact.h"
+#include "profile.h"
+#include <algorithm>
+#include <iostream>
+
+// cells per packed word
+static const int per_word = 32;
+
+compact_octant::compact_octant(int width) :
+    width(width),
+    offsets(width + 1),
+    overflow(width) {
+    offsets[0] = 0;
+    for (int i = 0; i < width; i++) {
+        offsets[i+1] = offsets[i] + (length(i) + per_word - 1) / per_word;
+    }
+    words.assign(offsets[width], 0);
+}
+
+static bool before(const std::pair<int, cell_t> &entry, int j) {
+    return entry.first < j;
+}
+
+cell_t compact_octant::get(int i, int j) const {
+    cell_t low = words[offsets[i] + j / per_word] >> (2 * (j % per_word)) & 3;
+    const auto &list = overflow[i];
+    auto entry = std::lower_bound(list.begin(), list.end(), j, before);
+    if (entry != list.end() and entry->first == j) return low + 4 * entry->second;
+    return low;
+}
+
+void compact_octant::set(int i, int j, cell_t height) {
+    std::uint64_t &word = words[offsets[i] + j / per_word];
+    int shift = 2 * (j % per_word);
+    word = (word & ~(3ull << shift)) | (std::uint64_t)(height & 3) << shift;
+    auto &list = overflow[i];
+    auto entry = std::lower_bound(list.begin(), list.end(), j, before);
+    bool found = entry != list.end() and entry->first == j;
+    if (height >= 4 and found) entry->second = height / 4;
+    else if (height >= 4) list.insert(entry, {j, height / 4});
+    else if (found) list.erase(entry);
+}
+
+void compact_octant::unpack(int i, int extent, cell_t *out) const {
+    const std::uint64_t *column = words.data() + offsets[i];
+    int j = 0;
+    for (; j + per_word <= extent; j += per_word) {
+        std::uint64_t word = column[j / per_word];
+        for (int k = 0; k < per_word; k++) {
+            out[j+k] = word >> (2 * k) & 3;
+        }
+    }
+    for (int k = 0; j + k < extent; k++) {
+        out[j+k] = column[j / per_word] >> (2 * k) & 3;
+    }
+    for (const auto &entry : overflow[i]) {
+        if (entry.first >= extent) break;
+        out[entry.first] += 4 * entry.second;
+    }
+}
+
+void compact_octant::pack(int i, int extent, const cell_t *in) {
+    std::uint64_t *column = words.data() + offsets[i];
+    cell_t high = 0;
+    for (int j = 0; j < extent; j += per_word) {
+        int n = std::min(per_word, extent - j);
+        std::uint64_t word = 0;
+        if (n == per_word) {
+            for (int k = 0; k < per_word; k++) {
+                word |= (std::uint64_t)(in[j+k] & 3) << (2 * k);
+                high |= in[j+k] >> 2;
+            }
+        } else {
+            for (int k = 0; k < n; k++) {
+                word |= (std::uint64_t)(in[j+k] & 3) << (2 * k);
+                high |= in[j+k] >> 2;
+            }
+            word |= column[j / per_word] & (~0ull << (2 * n));
+        }
+        column[j / per_word] = word;
+    }
+    // rebuild the overflow entries below extent, reusing the old list's
+    // storage so a sweep does not allocate
+    auto &list = overflow[i];
+    auto rest = std::lower_bound(list.begin(), list.end(), extent, before);
+    if (high == 0) {
+        list.erase(list.begin(), rest);
+        return;
+    }
+    scratch.clear();
+    for (int j = 0; j < extent; j++) {
+        if (in[j] >= 4) scratch.push_back({j, in[j] / 4});
+    }
+    scratch.insert(scratch.end(), rest, list.end());
+    list.swap(scratch);
+}
+
+std::size_t compact_octant::bytes() const {
+    std::size_t total = words.size() * sizeof(std::uint64_t) +
+                        offsets.size() * sizeof(std::size_t);
+    for (const auto &list : overflow) {
+        total += sizeof(list) + list.capacity() * sizeof(list[0]);
+    }
+    return total;
+}
+
+compact_pile::compact_pile(int N) :
+    cells(std::max(N, 4)),
+    j_range(cells.width, 2),
+    i_range(cells.width - 1),
+    kernel(select_kernel()) {
+    // the narrowest columns are all sink past j = 1
+    for (int i = 0; i < cells.width; i++) {
+        j_range[i] = std::min(j_range[i], cells.length(i) - 1);
+    }
+}
+
+int compact_pile::stabilize() {
+    int width = cells.width;
+    std::vector<cell_t> slot[3];
+    int extent[3] = {0, 0, 0};
+    // a column nobody toppled into since it was unpacked needs no packing
+    bool touched[3] = {false, false, false};
+    for (auto &buffer : slot) buffer.assign(width + octant::pad, 0);
+
+    // Cells of column k a sweep can touch: toppling columns k-1, k and k+1
+    // reaches one past their j_range, which itself may grow by one.
+    auto reach = [&](int k) {
+        int j = j_range[k];
+        if (k > 0) j = std::max(j, j_range[k-1]);
+        if (k+1 < width) j = std::max(j, j_range[k+1]);
+        return std::min(j + 3, cells.length(k));
+    };
+    auto load = [&](int k) {
+        cell_t *buffer = slot[k % 3].data();
+        int e = reach(k);
+        std::fill(buffer + e, buffer + std::max(e, extent[k % 3]), 0);
+        cells.unpack(k, e, buffer);
+        extent[k % 3] = e;
+        touched[k % 3] = false;
+    };
+    auto store = [&](int k) {
+        if (touched[k % 3]) cells.pack(k, extent[k % 3], slot[k % 3].data());
+    };
+
+    bool done = false;
+    int count = 0;
+    while (not done) {
+        PROFILE_SCOPE("compact sweep");
+        done = true;
+        load(0);
+        for (int i = 0; i < i_range; i++) {
+            load(i + 1);
+            cell_t *column = slot[i % 3].data();
+            cell_t *left = i > 0 ? slot[(i-1) % 3].data() : nullptr;
+            cell_t *right = slot[(i+1) % 3].data();
+            bool toppled = topple_cells(i, column, left, right, nullptr,
+                                        0, j_range[i], kernel);
+            // check to expand j_range
+            int j = j_range[i];
+            if (column[j] >= 4 and j < cells.length(i) - 1) {
+                j_range[i]++;
+                topple_cells(i, column, left, right, nullptr, j, j+1, kernel);
+                toppled = true;
+            }
+            if (toppled) {
+                done = false;
+                touched[(i+2) % 3] = touched[i % 3] = touched[(i+1) % 3] = true;
+            }
+            if (i > 0) store(i - 1);
+        }
+        store(i_range - 1);
+        store(i_range);
+        count++;
+    }
+    // a stable pile keeps no overflow, give back what the sweeps used
+    for (auto &list : cells.overflow) list.shrink_to_fit();
+    cells.scratch = std::vector<std::pair<int, cell_t>>();
+    std::cout << count << " compact sweeps" << std::endl;
+    sweeps += count;
+    return count;
+}
+
+row_source compact_rows(const compact_octant &cells) {
+    return [&cells](int ay, unsigned char *row) {
+        for (int ax = 0; ax < cells.width; ax++) {
+            cell_t height = ax <= ay ? cells.get(ay - ax, ax)
+                                     : cells.get(ax - ay, ay);
+            row[ax] = std::min<cell_t>(height, 255);
+        }
+    };
+}
+
+span_source compact_spans(const compact_octant &cells) {
+    return [&cells](int ay, int ax0, int n, unsigned char *span) {
+        for (int ax = ax0; ax < ax0 + n; ax++) {
+            cell_t height = ax <= ay ? cells.get(ay - ax, ax)
+                                     : cells.get(ax - ay, ay);
+            span[ax - ax0] = std::min<cell_t>(height, 255);
+        }
+    };
+}
@@ -0,0 +1,52 @@
+#ifndef COMPACT_H
+#define COMPACT_H
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "octant.h"
+#include "kernel.h"
+#include "render.h"
+
+// Octant at 2 bits per cell.  A cell holds height % 4 in its column's
+// packed words; the few cells with height >= 4, the source and the active
+// frontier, also keep height / 4 in a per column overflow list sorted by j.
+// Columns are packed 32 cells to a word, in the same sheared coordinates as
+// octant.
+struct compact_octant {
+    int width;
+    std::vector<std::size_t> offsets;   // first word of column i
+    std::vector<std::uint64_t> words;
+    std::vector<std::vector<std::pair<int, cell_t>>> overflow;
+    std::vector<std::pair<int, cell_t>> scratch;     // spare list for pack
+    explicit compact_octant(int width);
+    int length(int i) const { return width - i; }
+    cell_t get(int i, int j) const;
+    void set(int i, int j, cell_t height);
+    // cells 0 <= j < extent of column i to and from a plain buffer; pack
+    // leaves the cells past extent alone
+    void unpack(int i, int extent, cell_t *out) const;
+    void pack(int i, int extent, const cell_t *in);
+    std::size_t bytes() const;
+};
+
+// Single threaded stabilizer on a compact octant.  It slides a window of
+// three unpacked columns down the octant: column i topples through the
+// usual run kernels into its unpacked neighbours, and column i-1, which
+// nothing touches any more this sweep, is packed back.  Only the cells a
+// sweep can reach, a few past j_range, are ever unpacked.
+struct compact_pile {
+    compact_octant cells;
+    std::vector<int> j_range;
+    int i_range;
+    run_kernel kernel;
+    std::uint64_t sweeps = 0;
+    explicit compact_pile(int N);
+    int stabilize();
+};
+
+// plane rows of a compact octant for the renderer
+row_source compact_rows(const compact_octant &cells);
+span_source compact_spans(const compact_octant &cells);
+
+#endif
@@ -1 +1,5 @@
-g++ -O2 -std=c++17 -pthread sandpile.cpp pile.cpp -lSDL2
+g++ -O2 -std=c++17 -pthread sandpile.cpp pile.cpp tiles.cpp octant.cpp kernel.cpp pool.cpp telemetry.cpp options.cpp warmstart.cpp snapshot.cpp frames.cpp render.cpp pyramid.cpp compact.cpp driven.cpp sweep.cpp profile.cpp sliced.cpp procs.cpp
+# with the SDL viewer behind --view 1:
+# g++ -O2 -std=c++17 -pthread -DUSE_SDL sandpile.cpp pile.cpp tiles.cpp octant.cpp kernel.cpp pool.cpp telemetry.cpp options.cpp warmstart.cpp snapshot.cpp frames.cpp render.cpp pyramid.cpp compact.cpp driven.cpp sweep.cpp profile.cpp sliced.cpp procs.cpp -lSDL2
+# with phase timers and hardware counters behind --profile FILE:
+# g++ -O2 -std=c++17 -pthread -DSANDPILE_PROFILE sandpile.cpp pile.cpp tiles.cpp octant.cpp kernel.cpp pool.cpp telemetry.cpp options.cpp warmstart.cpp snapshot.cpp frames.cpp render.cpp pyramid.cpp compact.cpp driven.cpp sweep.cpp profile.cpp sliced.cpp procs.cpp
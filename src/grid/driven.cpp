@@ -0,0 +1,140 @@
+#include "driven.h"
+#include "profile.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+
+void log_histogram::add(std::uint64_t value) {
+    int k = 0;
+    for (; value != 0; value >>= 1) k++;
+    if (counts.size() <= (std::size_t)k) counts.resize(k + 1, 0);
+    counts[k]++;
+}
+
+void avalanche_stats::add(const avalanche &a) {
+    drops++;
+    topples += a.size;
+    lost += a.lost;
+    size.add(a.size);
+    area.add(a.area);
+    duration.add(a.duration);
+    radius.add(a.radius);
+}
+
+bool write_histograms(const std::string &path, const avalanche_stats &stats) {
+    std::ofstream out(path);
+    if (not out) {
+        std::cout << "cannot write histograms to " << path << std::endl;
+        return false;
+    }
+    const log_histogram *columns[4] = {&stats.size, &stats.area,
+                                       &stats.duration, &stats.radius};
+    std::size_t bins = 0;
+    for (const log_histogram *h : columns) bins = std::max(bins, h->counts.size());
+    out << "# " << stats.drops << " drops, " << stats.topples << " topples, " <<
+           stats.lost << " grains lost\n";
+    out << "# low high size area duration radius\n";
+    for (std::size_t k = 0; k < bins; k++) {
+        out << log_histogram::bin_low(k) << " " << log_histogram::bin_low(k + 1);
+        for (const log_histogram *h : columns) {
+            out << " " << (k < h->counts.size() ? h->counts[k] : 0);
+        }
+        out << "\n";
+    }
+    return bool(out);
+}
+
+driven_pile::driven_pile(int width) :
+    width(std::max(width, 3)),
+    side(2 * this->width - 1),
+    heights((std::size_t)side * side, 0),
+    stamp(heights.size(), 0) {
+    // the member, the parameter may be below the clamp
+    int w = this->width;
+    for (int k = 1 - w; k < w; k++) {
+        (*this)(k, 1 - w) = (*this)(k, w - 1) = sink;
+        (*this)(1 - w, k) = (*this)(w - 1, k) = sink;
+    }
+}
+
+driven_pile::driven_pile(const pile &sandpile) :
+    driven_pile(sandpile.nodes.width) {
+    for (int y = 2 - width; y < width - 1; y++) {
+        for (int x = 2 - width; x < width - 1; x++) {
+            // plane point (x, y) folds onto octant cell (hi - lo, lo)
+            int lo = std::min(std::abs(x), std::abs(y));
+            int hi = std::max(std::abs(x), std::abs(y));
+            (*this)(x, y) = sandpile.nodes(hi - lo, lo);
+        }
+    }
+}
+
+// A stable pile plus one grain topples every cell at most once per wave:
+// the first wave is the one cell at 4, and a wave of cells below 8 hands
+// each cell at most 4 grains, so no cell climbs past 7 and a toppling
+// always sheds exactly 4 grains.  A cell joins the next wave the moment
+// it reaches 4.
+avalanche driven_pile::drop(int x, int y) {
+    avalanche a;
+    std::uint32_t origin = (std::uint32_t)(y + width - 1) * side + x + width - 1;
+    if (++heights[origin] < 4) return a;
+    if (++avalanches == 0) {
+        // stamps wrapped around, old ones could pass for this avalanche
+        std::fill(stamp.begin(), stamp.end(), 0);
+        avalanches = 1;
+    }
+    std::uint32_t farthest = 0;
+    if (wave.empty()) wave.resize(1);
+    wave[0] = origin;
+    std::size_t length = 1;
+    while (length != 0) {
+        a.duration++;
+        // written without branches, the heights being too random to guess
+        if (next_wave.size() < 4 * length) next_wave.resize(4 * length);
+        std::size_t next_length = 0;
+        for (std::size_t k = 0; k < length; k++) {
+            std::uint32_t c = wave[k];
+            heights[c] -= 4;
+            if (stamp[c] != avalanches) {
+                stamp[c] = avalanches;
+                a.area++;
+                std::int64_t dx = int(c % side) - (x + width - 1);
+                std::int64_t dy = int(c / side) - (y + width - 1);
+                farthest = std::max<std::uint32_t>(farthest, dx * dx + dy * dy);
+            }
+            const std::uint32_t neighbours[4] = {c - 1, c + 1, c - side, c + side};
+            for (std::uint32_t n : neighbours) {
+                unsigned char h = heights[n];
+                bool inside = h != sink;
+                a.lost += not inside;
+                h += inside;
+                heights[n] = h;
+                next_wave[next_length] = n;
+                next_length += h == 4;
+            }
+        }
+        a.size += length;
+        wave.swap(next_wave);
+        length = next_length;
+    }
+    a.radius = std::sqrt(double(farthest));
+    return a;
+}
+
+void driven_pile::drive(std::uint64_t drops, bool random, std::mt19937_64 &rng,
+                        avalanche_stats &stats) {
+    PROFILE_SCOPE("drops");
+    std::uniform_int_distribution<int> site(2 - width, width - 2);
+    for (std::uint64_t k = 0; k < drops; k++) {
+        int x = random ? site(rng) : 0;
+        int y = random ? site(rng) : 0;
+        stats.add(drop(x, y));
+    }
+}
+
+std::uint64_t driven_pile::grains() const {
+    std::uint64_t total = 0;
+    for (unsigned char h : heights) total += h == sink ? 0 : h;
+    return total;
+}
@@ -0,0 +1,80 @@
+#ifndef DRIVEN_H
+#define DRIVEN_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+#include "pile.h"
+
+// Driven sandpile.  Single grains dropped one at a time on a stable pile
+// break the eightfold symmetry the octant relies on, so the driven pile
+// keeps the whole square of plane points |x|, |y| < width, its outer ring
+// being the sink like the octant's last diagonal.  Only the avalanche a
+// drop sets off is relaxed: unstable cells wait in a list, one list per
+// wave of parallel topplings, and most drops topple nothing at all.
+
+// what one drop set off
+struct avalanche {
+    std::uint64_t size = 0;     // topplings
+    std::uint32_t area = 0;     // distinct cells that toppled
+    std::uint32_t duration = 0; // waves of parallel topplings
+    std::uint32_t radius = 0;   // farthest toppling from the drop, rounded down
+    std::uint64_t lost = 0;     // grains that fell into the sink
+};
+
+// Counts in power of two bins: bin 0 holds 0 and bin k holds
+// [2^(k-1), 2^k), so power laws come out as straight lines.
+struct log_histogram {
+    std::vector<std::uint64_t> counts;
+    void add(std::uint64_t value);
+    static std::uint64_t bin_low(int k) { return k == 0 ? 0 : 1ull << (k - 1); }
+};
+
+struct avalanche_stats {
+    std::uint64_t drops = 0;
+    std::uint64_t topples = 0;
+    std::uint64_t lost = 0;
+    log_histogram size, area, duration, radius;
+    void add(const avalanche &a);
+};
+
+// Writes the four histograms side by side, one bin per line:
+//   # low high size area duration radius
+bool write_histograms(const std::string &path, const avalanche_stats &stats);
+
+class driven_pile {
+public:
+    int width;
+    int side;                           // 2 width - 1
+    // side x side, row by row; the ring of sink cells holds the marker
+    // sink and never changes, so toppling needs no bounds checks
+    std::vector<unsigned char> heights;
+    static const unsigned char sink = 0x80;
+    driven_pile(int width);
+    // unfolds a stable octant pile onto the square
+    explicit driven_pile(const pile &sandpile);
+
+    unsigned char &operator()(int x, int y) {
+        return heights[(std::size_t)(y + width - 1) * side + x + width - 1];
+    }
+    bool in_sink(int x, int y) const {
+        return std::abs(x) == width - 1 or std::abs(y) == width - 1;
+    }
+    // adds a grain at (x, y), inside the sink ring, and relaxes the pile
+    // again
+    avalanche drop(int x, int y);
+    // drops grains at random points inside the sink, or all at the origin
+    void drive(std::uint64_t drops, bool random, std::mt19937_64 &rng,
+               avalanche_stats &stats);
+    // grains on the pile, the sink not counted
+    std::uint64_t grains() const;
+private:
+    // the avalanche a cell last toppled in, so area needs no clearing
+    std::vector<std::uint32_t> stamp;
+    std::uint32_t avalanches = 0;
+    std::vector<std::uint32_t> wave, next_wave;
+};
+
+#endif
@@ -0,0 +1,95 @@
+#ifndef FOLD_H
+#define FOLD_H
+
+// Lattice and symmetry policies for the octant kernels.  A lattice policy
+// lists the plane neighbours of a point; a fold policy maps plane points
+// onto stored cells and back.  fold_weights turns the two into constexpr
+// tables: how many grains a cell sends to each cell it reaches per
+// toppling, and how many plane points it stands for.  The kernels take
+// their boundary cases from these tables at compile time, so a new stencil
+// or fold is a new pair of policies, not a new kernel.
+
+struct square_lattice {
+    static constexpr int degree = 4;
+    static constexpr int dx[degree] = {1, -1, 0, 0};
+    static constexpr int dy[degree] = {0, 0, 1, -1};
+};
+
+// the octant 0 <= x <= y in sheared coordinates, see octant.h
+struct octant_fold {
+    static constexpr int x(int /*i*/, int j) { return j; }
+    static constexpr int y(int i, int j) { return i + j; }
+    static constexpr int abs(int v) { return v < 0 ? -v : v; }
+    static constexpr int i_of(int x, int y) {
+        return abs(x) < abs(y) ? abs(y) - abs(x) : abs(x) - abs(y);
+    }
+    static constexpr int j_of(int x, int y) {
+        return abs(x) < abs(y) ? abs(x) : abs(y);
+    }
+};
+
+// Columns of the octant only ever reach their neighbours: a toppling of
+// cell (i, j) lands on (i + spill_di[k], j + spill_dj[k]), which the
+// kernels know as left[j], left[j+1], right[j-1] and right[j].
+constexpr int spills = 4;
+constexpr int spill_di[spills] = {-1, -1, 1, 1};
+constexpr int spill_dj[spills] = {0, 1, -1, 0};
+
+template <class Lattice, class Fold>
+struct fold_weights {
+    // plane points stored in cell (i, j)
+    static constexpr int multiplicity(int i, int j) {
+        int r = Fold::y(i, j) < 0 ? -Fold::y(i, j) : Fold::y(i, j);
+        r += Fold::x(i, j) < 0 ? -Fold::x(i, j) : Fold::x(i, j);
+        int count = 0;
+        for (int x = -r; x <= r; x++) {
+            for (int y = -r; y <= r; y++) {
+                count += Fold::i_of(x, y) == i and Fold::j_of(x, y) == j;
+            }
+        }
+        return count;
+    }
+    // Grains cell (i, j) sends to its k-th spill per toppling.  Every
+    // plane point of the target gets what its neighbours stored in (i, j)
+    // shed, so count those neighbours of the target's own point.
+    static constexpr int weight(int i, int j, int k) {
+        int ti = i + spill_di[k], tj = j + spill_dj[k];
+        if (ti < 0 or tj < 0) return 0;
+        int count = 0;
+        for (int n = 0; n < Lattice::degree; n++) {
+            int x = Fold::x(ti, tj) + Lattice::dx[n];
+            int y = Fold::y(ti, tj) + Lattice::dy[n];
+            count += Fold::i_of(x, y) == i and Fold::j_of(x, y) == j;
+        }
+        return count;
+    }
+    // every grain shed lands on one of the spills
+    static constexpr bool conserves(int i, int j) {
+        int landed = 0;
+        for (int k = 0; k < spills; k++) {
+            landed += weight(i, j, k) * multiplicity(i + spill_di[k],
+                                                     j + spill_dj[k]);
+        }
+        return landed == Lattice::degree * multiplicity(i, j);
+    }
+    // cells past the second row and column all behave like (2, 2), so the
+    // kernels peel rows and columns 0 and 1 and share one case for the rest
+    static constexpr bool same_as(int i, int j, int ri, int rj) {
+        bool same = multiplicity(i, j) == multiplicity(ri, rj);
+        for (int k = 0; k < spills; k++) same &= weight(i, j, k) == weight(ri, rj, k);
+        return same;
+    }
+};
+
+typedef fold_weights<square_lattice, octant_fold> octant_weights;
+
+static_assert(octant_weights::conserves(0, 0) and octant_weights::conserves(0, 1) and
+              octant_weights::conserves(1, 0) and octant_weights::conserves(1, 1) and
+              octant_weights::conserves(2, 2) and octant_weights::conserves(0, 5),
+              "the octant spills every grain into its neighbouring columns");
+static_assert(octant_weights::same_as(0, 7, 0, 2) and octant_weights::same_as(1, 7, 1, 2) and
+              octant_weights::same_as(7, 0, 2, 0) and octant_weights::same_as(7, 1, 2, 1) and
+              octant_weights::same_as(7, 7, 2, 2),
+              "rows and columns past 1 share their weights");
+
+#endif
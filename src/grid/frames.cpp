@@ -0,0 +1,113 @@
+#include "frames.h"
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <utility>
+
+row_source snapshot_rows(const snapshot &shot, int width) {
+    octant_view grid{const_cast<cell_t*>(shot.cells.data()), shot.offsets.data(),
+                     shot.header.width};
+    return [grid, width](int ay, unsigned char *row) {
+        std::fill(row, row + width, 0);
+        // folded as in octant_rows, with the plane past grid.width empty
+        for (int ax = 0; ax <= ay and ay < grid.width; ax++) {
+            row[ax] = std::min<cell_t>(grid(ay - ax, ax), 255);
+        }
+        for (int ax = ay + 1; ax < grid.width; ax++) {
+            row[ax] = std::min<cell_t>(grid(ax - ay, ay), 255);
+        }
+    };
+}
+
+FrameWriter::FrameWriter(std::string path, int width, int threads) :
+    path(std::move(path)),
+    width(width),
+    painters(threads),
+    has_pending(false),
+    encoding(false),
+    not_done(true),
+    frames(0) {
+    std::string ext = this->path.substr(this->path.find_last_of('.') + 1);
+    if (ext == "y4m") {
+        stream.open(this->path, std::ios::binary);
+        if (stream) write_y4m_header(stream, width);
+    }
+    if ((ext == "y4m" and not stream) or
+        (ext != "y4m" and ext != "png" and ext != "bmp")) {
+        std::cout << "cannot write frames to " << this->path <<
+                     ", use .y4m, .png or .bmp" << std::endl;
+        this->path.clear();
+    }
+    thread = std::thread(&FrameWriter::writer_loop, this);
+}
+
+FrameWriter::~FrameWriter() {
+    wait();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        not_done = false;
+    }
+    writer_cv.notify_one();
+    thread.join();
+}
+
+void FrameWriter::encode(const snapshot &shot) {
+    if (path.empty()) return;
+    row_source rows = snapshot_rows(shot, width);
+    if (stream.is_open()) {
+        if (not write_y4m_frame(stream, width, rows, painters)) {
+            std::cout << "writing " << path << " failed" << std::endl;
+        }
+        return;
+    }
+    std::size_t dot = path.find_last_of('.');
+    char number[16];
+    std::snprintf(number, sizeof(number), "-%06d", frames);
+    write_image(path.substr(0, dot) + number + path.substr(dot), width, rows,
+                painters);
+}
+
+void FrameWriter::writer_loop() {
+    while (true) {
+        snapshot shot;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            writer_cv.wait(lock, [this] { return has_pending or not not_done; });
+            if (not has_pending) return;
+            shot = std::move(pending);
+            has_pending = false;
+            encoding = true;
+        }
+        idle_cv.notify_all();
+        encode(shot);
+        std::lock_guard<std::mutex> lock(mutex);
+        encoding = false;
+        frames++;
+        idle_cv.notify_all();
+    }
+}
+
+bool FrameWriter::ready() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return not has_pending;
+}
+
+void FrameWriter::submit(snapshot shot) {
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        idle_cv.wait(lock, [this] { return not has_pending; });
+        pending = std::move(shot);
+        has_pending = true;
+    }
+    writer_cv.notify_one();
+}
+
+void FrameWriter::wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    idle_cv.wait(lock, [this] { return not has_pending and not encoding; });
+}
+
+int FrameWriter::written() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return frames;
+}
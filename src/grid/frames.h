@@ -0,0 +1,59 @@
+#ifndef FRAMES_H
+#define FRAMES_H
+
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "pool.h"
+#include "render.h"
+#include "snapshot.h"
+
+// Time-lapse of a pile while it stabilizes.  The stabilizers copy the pile
+// for a frame the way they copy it for a checkpoint, and only when the
+// writer has room for it: one frame being encoded and one waiting, so
+// workers never wait for the encoder and a slow encoder just spaces the
+// frames further apart.  Frames are drawn on the writer's own thread.
+//
+// A path ending in .y4m gets one YUV4MPEG2 stream; .png or .bmp paths get
+// numbered images, out/run.png becoming out/run-000000.png and on.  Every
+// frame is 2 width - 1 pixels square, width being the widest the pile can
+// grow to, so a growing pile keeps its scale.
+
+// rows of a snapshot as a picture width wide, zero past the snapshot's edge
+row_source snapshot_rows(const snapshot &shot, int width);
+
+class FrameWriter {
+private:
+    std::mutex mutex;
+    std::condition_variable writer_cv;
+    std::condition_variable idle_cv;
+    std::thread thread;
+    std::string path;
+    int width;
+    ThreadPool painters;
+    std::ofstream stream;       // the .y4m stream, unused for images
+    snapshot pending;
+    bool has_pending;
+    bool encoding;
+    bool not_done;
+    int frames;
+    void writer_loop();
+    void encode(const snapshot &shot);
+public:
+    FrameWriter(std::string path, int width, int threads = 1);
+    ~FrameWriter();
+    FrameWriter(const FrameWriter &) = delete;
+    FrameWriter &operator=(const FrameWriter &) = delete;
+    // whether a frame submitted now would be encoded without waiting
+    bool ready();
+    // waits while another frame is waiting, so none is ever dropped
+    void submit(snapshot shot);
+    // blocks until everything submitted so far is written
+    void wait();
+    int written();
+    bool good() const { return not path.empty(); }
+};
+
+#endif
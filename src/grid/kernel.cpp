@@ -0,0 +1,217 @@
+#include "kernel.h"
+#include "fold.h"
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define X86_KERNELS
+#endif
+
+
+std::uint64_t topple_run_scalar(cell_t *column, cell_t *left, cell_t *right,
+                                std::uint64_t *odometer, int lo, int hi) {
+    std::uint64_t topples = 0;
+    for (int j = lo; j < hi; j++) {
+        if (column[j] >= 4) {
+            cell_t spillover = column[j] / 4;
+            column[j] = column[j] % 4;
+            topples += spillover;
+            if (odometer != nullptr) odometer[j] += spillover;
+            // spills
+            left[j+1] += spillover;
+            right[j-1] += spillover;
+            right[j] += spillover;
+            left[j] += spillover;
+        }
+    }
+    return topples;
+}
+
+#ifdef X86_KERNELS
+
+// Branch free version of the loop above on vec-sized runs: the spillover
+// of a cell below 4 is zero, so every lane can be shifted, masked and added
+// unconditionally.  The overlapping left/right stores are done in order, so
+// neighbouring lanes that hit the same cell still add up.  With the
+// reservoir keeping cells near 2^30 a run's topplings overflow 32 bits, so
+// the lane sums go to 64 bit lanes every 4 vectors; a cell spills less
+// than 2^30, and 4 of those fit.
+template <typename vec, typename wide, bool counting>
+__attribute__((always_inline))
+static inline std::uint64_t topple_run_vec(cell_t *column, cell_t *left,
+                                           cell_t *right, std::uint64_t *odometer,
+                                           int lo, int hi) {
+    const int lanes = sizeof(vec) / sizeof(cell_t);
+    wide total = {};
+    vec recent = {};
+    int pending = 0;
+    vec x, s, t;
+    wide c;
+    int j = lo;
+    for (; j + lanes <= hi; j += lanes) {
+        std::memcpy(&x, column + j, sizeof(vec));
+        s = x >> 2;
+        recent += s;
+        if (++pending == 4) {
+            total += __builtin_convertvector(recent, wide);
+            recent = vec{};
+            pending = 0;
+        }
+        x &= 3;
+        std::memcpy(column + j, &x, sizeof(vec));
+        if (counting) {
+            std::memcpy(&c, odometer + j, sizeof(wide));
+            c += __builtin_convertvector(s, wide);
+            std::memcpy(odometer + j, &c, sizeof(wide));
+        }
+        // spills
+        std::memcpy(&t, left + j, sizeof(vec));
+        t += s;
+        std::memcpy(left + j, &t, sizeof(vec));
+        std::memcpy(&t, left + j + 1, sizeof(vec));
+        t += s;
+        std::memcpy(left + j + 1, &t, sizeof(vec));
+        std::memcpy(&t, right + j - 1, sizeof(vec));
+        t += s;
+        std::memcpy(right + j - 1, &t, sizeof(vec));
+        std::memcpy(&t, right + j, sizeof(vec));
+        t += s;
+        std::memcpy(right + j, &t, sizeof(vec));
+    }
+    std::uint64_t topples = 0;
+    for (int k = 0; k < lanes; k++) {
+        topples += total[k] + recent[k];
+    }
+    return topples + topple_run_scalar(column, left, right, odometer, j, hi);
+}
+
+typedef cell_t vec256 __attribute__((vector_size(32)));
+typedef cell_t vec512 __attribute__((vector_size(64)));
+typedef std::uint64_t wide256 __attribute__((vector_size(64)));
+typedef std::uint64_t wide512 __attribute__((vector_size(128)));
+
+__attribute__((target("avx2")))
+std::uint64_t topple_run_avx2(cell_t *column, cell_t *left, cell_t *right,
+                              std::uint64_t *odometer, int lo, int hi) {
+    if (odometer != nullptr) {
+        return topple_run_vec<vec256, wide256, true>(column, left, right,
+                                                     odometer, lo, hi);
+    }
+    return topple_run_vec<vec256, wide256, false>(column, left, right,
+                                                  odometer, lo, hi);
+}
+
+__attribute__((target("avx512f")))
+std::uint64_t topple_run_avx512(cell_t *column, cell_t *left, cell_t *right,
+                                std::uint64_t *odometer, int lo, int hi) {
+    if (odometer != nullptr) {
+        return topple_run_vec<vec512, wide512, true>(column, left, right,
+                                                     odometer, lo, hi);
+    }
+    return topple_run_vec<vec512, wide512, false>(column, left, right,
+                                                  odometer, lo, hi);
+}
+
+#else
+
+std::uint64_t topple_run_avx2(cell_t *column, cell_t *left, cell_t *right,
+                              std::uint64_t *odometer, int lo, int hi) {
+    return topple_run_scalar(column, left, right, odometer, lo, hi);
+}
+
+std::uint64_t topple_run_avx512(cell_t *column, cell_t *left, cell_t *right,
+                                std::uint64_t *odometer, int lo, int hi) {
+    return topple_run_scalar(column, left, right, odometer, lo, hi);
+}
+
+#endif
+
+// One cell of class (I, J): rows and columns 0 and 1 are their own
+// classes, 2 stands for everything past them.  Weights come from the fold
+// tables, and spills of weight 0, like left of column 0, are compiled out.
+template <int I, int J>
+__attribute__((always_inline))
+static inline std::uint64_t topple_cell(cell_t *column, cell_t *left, cell_t *right,
+                                        std::uint64_t *odo, int j) {
+    constexpr int degree = square_lattice::degree;
+    constexpr cell_t w0 = octant_weights::weight(I, J, 0);
+    constexpr cell_t w1 = octant_weights::weight(I, J, 1);
+    constexpr cell_t w2 = octant_weights::weight(I, J, 2);
+    constexpr cell_t w3 = octant_weights::weight(I, J, 3);
+    constexpr std::uint64_t multiplicity = octant_weights::multiplicity(I, J);
+    if (column[j] < degree) return 0;
+    cell_t spillover = column[j] / degree;
+    column[j] = column[j] % degree;
+    if (odo != nullptr) odo[j] += spillover;
+    // spills
+    if constexpr (w0 != 0) left[j] += w0 * spillover;
+    if constexpr (w1 != 0) left[j+1] += w1 * spillover;
+    if constexpr (w2 != 0) right[j-1] += w2 * spillover;
+    if constexpr (w3 != 0) right[j] += w3 * spillover;
+    return multiplicity * spillover;
+}
+
+template <int I>
+static std::uint64_t topple_class(cell_t *column, cell_t *left, cell_t *right,
+                                  std::uint64_t *odo, int lo, int hi,
+                                  run_kernel kernel) {
+    std::uint64_t topples = 0;
+    int j = lo;
+    if (j == 0 and j < hi) topples += topple_cell<I, 0>(column, left, right, odo, j++);
+    if (j == 1 and j < hi) topples += topple_cell<I, 1>(column, left, right, odo, j++);
+    if constexpr (I < 2) {
+        for (; j < hi; j++) topples += topple_cell<I, 2>(column, left, right, odo, j);
+    } else if (j < hi) {
+        static_assert(octant_weights::weight(2, 2, 0) == 1 and
+                      octant_weights::weight(2, 2, 1) == 1 and
+                      octant_weights::weight(2, 2, 2) == 1 and
+                      octant_weights::weight(2, 2, 3) == 1,
+                      "the run kernels spill one grain to each neighbour");
+        topples += octant_weights::multiplicity(2, 2) *
+                   kernel(column, left, right, odo, j, hi);
+    }
+    return topples;
+}
+
+// Topples the cells lo <= j < hi of column i once, see kernel.h.  Columns
+// 0 and 1 and rows 0 and 1 lie on the folds of the octant and carry its
+// boundary weights, everything else goes through the run kernel.  A cell's
+// topplings count once per plane point folded onto it: 1 at the origin, 4
+// on the axes and diagonal, 8 in the bulk.
+std::uint64_t topple_cells(int i, cell_t *column, cell_t *left, cell_t *right,
+                           std::uint64_t *odo, int lo, int hi, run_kernel kernel) {
+    if (i == 0) return topple_class<0>(column, left, right, odo, lo, hi, kernel);
+    if (i == 1) return topple_class<1>(column, left, right, odo, lo, hi, kernel);
+    return topple_class<2>(column, left, right, odo, lo, hi, kernel);
+}
+
+static bool cpu_supports(run_kernel kernel) {
+#ifdef X86_KERNELS
+    if (kernel == topple_run_avx512) return __builtin_cpu_supports("avx512f");
+    if (kernel == topple_run_avx2) return __builtin_cpu_supports("avx2");
+    return true;
+#else
+    return kernel == topple_run_scalar;
+#endif
+}
+
+run_kernel select_kernel() {
+    if (cpu_supports(topple_run_avx512)) return topple_run_avx512;
+    if (cpu_supports(topple_run_avx2)) return topple_run_avx2;
+    return topple_run_scalar;
+}
+
+run_kernel kernel_by_name(const std::string &name) {
+    run_kernel kernel = nullptr;
+    if (name == "auto") kernel = select_kernel();
+    else if (name == "scalar") kernel = topple_run_scalar;
+    else if (name == "avx2") kernel = topple_run_avx2;
+    else if (name == "avx512") kernel = topple_run_avx512;
+    if (kernel != nullptr and not cpu_supports(kernel)) kernel = nullptr;
+    return kernel;
+}
+
+const char *kernel_name(run_kernel kernel) {
+    if (kernel == topple_run_avx512) return "avx512";
+    if (kernel == topple_run_avx2) return "avx2";
+    return "scalar";
+}
@@ -0,0 +1,40 @@
+#ifndef KERNEL_H
+#define KERNEL_H
+
+#include <cstdint>
+#include <string>
+#include "octant.h"
+
+// A run kernel topples the cells lo <= j < hi of a bulk column (i >= 2,
+// j >= 2).  Every cell keeps height % 4 and sends height / 4 to each of
+// (i-1, j), (i-1, j+1), (i+1, j-1) and (i+1, j).  Cells of one column never
+// feed each other, so a whole run can be toppled at once.  If odometer is
+// not nullptr the number of topplings of each cell is added to it.  Returns
+// the number of topplings, 0 if no cell toppled.
+typedef std::uint64_t (*run_kernel)(cell_t *column, cell_t *left, cell_t *right,
+                                    std::uint64_t *odometer, int lo, int hi);
+
+std::uint64_t topple_run_scalar(cell_t *column, cell_t *left, cell_t *right,
+                                std::uint64_t *odometer, int lo, int hi);
+std::uint64_t topple_run_avx2(cell_t *column, cell_t *left, cell_t *right,
+                              std::uint64_t *odometer, int lo, int hi);
+std::uint64_t topple_run_avx512(cell_t *column, cell_t *left, cell_t *right,
+                                std::uint64_t *odometer, int lo, int hi);
+
+// Topples the cells lo <= j < hi of column i of the octant once, with left
+// and right the columns i-1 and i+1 (left is unused for i = 0).  Handles
+// the fold weights of columns 0 and 1 and rows 0 and 1 itself and hands the
+// bulk of the run to kernel.  Engines differ only in where their columns
+// live, so they all topple through this.  Returns the number of plane
+// topplings, every cell toppling counted once per point folded onto it.
+std::uint64_t topple_cells(int i, cell_t *column, cell_t *left, cell_t *right,
+                           std::uint64_t *odometer, int lo, int hi,
+                           run_kernel kernel);
+
+// widest kernel the cpu we are running on supports
+run_kernel select_kernel();
+// "scalar", "avx2", "avx512" or "auto"; nullptr if unknown or unsupported
+run_kernel kernel_by_name(const std::string &name);
+const char *kernel_name(run_kernel kernel);
+
+#endif
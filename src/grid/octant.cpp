@@ -0,0 +1,49 @@
+#include "octant.h"
+#include <sys/mman.h>
+#include <algorithm>
+#include <new>
+#include <utility>
+
+
+std::vector<std::size_t> octant::layout(int capacity, int columns) {
+    std::vector<std::size_t> offsets(columns + 1);
+    offsets[0] = 0;
+    for (int i = 0; i < columns; i++) {
+        std::size_t padded = (capacity - i + pad - 1) / pad * pad;
+        offsets[i+1] = offsets[i] + padded;
+    }
+    return offsets;
+}
+
+// mmap hands out zeroed, page aligned memory and backs it lazily, so a
+// pile pays only for the columns and the cells it actually reaches
+octant::octant(int width, int capacity) :
+    width(width),
+    capacity(std::max(width, capacity)),
+    offsets(layout(this->capacity, this->capacity)) {
+    reserved = std::max<std::size_t>(offsets[this->capacity] * sizeof(cell_t), 1);
+    void *map = ::mmap(nullptr, reserved, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (map == MAP_FAILED) throw std::bad_alloc();
+    cells = static_cast<cell_t*>(map);
+}
+
+octant::octant(octant &&other) :
+    width(other.width),
+    capacity(other.capacity),
+    offsets(std::move(other.offsets)),
+    cells(other.cells),
+    reserved(other.reserved) {
+    other.cells = nullptr;
+}
+
+octant::~octant() {
+    if (cells != nullptr) ::munmap(cells, reserved);
+}
+
+bool octant::grow(int new_width) {
+    new_width = std::min(new_width, capacity);
+    if (new_width <= width) return false;
+    width = new_width;
+    return true;
+}
@@ -0,0 +1,55 @@
+#ifndef OCTANT_H
+#define OCTANT_H
+
+#include <cstddef>
+#include <vector>
+
+// The grid engine works in sheared octant coordinates: cell (i, j) is the
+// point (x, y) = (j, i + j) of the plane, so 0 <= x <= y.  Only cells with
+// y = i + j < width are ever drawn, so column i holds width - i cells.
+// All columns live in one aligned buffer, each padded out to a whole number
+// of cache lines so a column always starts on a 64 byte boundary.
+//
+// An octant may be given room to grow to a wider capacity.  Each column is
+// then laid out for capacity - i cells, the buffer is reserved address
+// space that the kernel only backs with memory once it is touched, and
+// growing is just raising width: no cell moves, and the cells past the old
+// sink are still zero.
+
+typedef unsigned int cell_t;
+
+struct octant_view {
+    cell_t *cells;
+    const std::size_t *offsets;
+    int width;
+    cell_t *column(int i) const { return cells + offsets[i]; }
+    cell_t &operator()(int i, int j) const { return cells[offsets[i] + j]; }
+    int length(int i) const { return width - i; }
+};
+
+struct octant {
+    static const int alignment = 64;
+    static const int pad = alignment / sizeof(cell_t);
+    int width;
+    int capacity;
+    std::vector<std::size_t> offsets;   // capacity + 1 of them
+    cell_t *cells;
+    std::size_t reserved;               // bytes mapped
+    explicit octant(int width, int capacity = 0);
+    octant(octant &&other);
+    octant(const octant &) = delete;
+    octant &operator=(const octant &) = delete;
+    ~octant();
+    cell_t *column(int i) const { return cells + offsets[i]; }
+    cell_t &operator()(int i, int j) const { return cells[offsets[i] + j]; }
+    int length(int i) const { return width - i; }
+    // cells up to the end of the last column in use, spare room included
+    std::size_t size() const { return offsets[width]; }
+    octant_view view() const { return octant_view{cells, offsets.data(), width}; }
+    // widens to min(new_width, capacity), returns whether it got any wider
+    bool grow(int new_width);
+    // offsets of the first columns + 1 columns of an octant of capacity
+    static std::vector<std::size_t> layout(int capacity, int columns);
+};
+
+#endif
@@ -0,0 +1,206 @@
+#include "options.h"
+#include "pool.h"
+#include <algorithm>
+#include <iostream>
+#include <cstdlib>
+
+static void usage(const char *program) {
+    std::cout << "usage: " << program << " [options]\n"
+              << "  --width N|auto   octant width, auto sizes it from the grains (default 600)\n"
+              << "  --max-width N|auto\n"
+              << "                   grow the octant up to N wide if grains reach its\n"
+              << "                   edge; auto allows a quarter past the sized width\n"
+              << "  --grains N       grains at the origin, N or 2^k up to 2^48 (default 2^21)\n"
+              << "  --threads N      worker threads, or processes (default: hardware threads)\n"
+              << "  --engine NAME    chain, bands, tiles, processes or compact (default\n"
+              << "                   chain); tiles relaxes tiles off work stealing queues,\n"
+              << "                   processes runs the bands in --threads processes over\n"
+              << "                   shared memory, compact keeps 2 bits per stable cell\n"
+              << "                   on one thread\n"
+              << "  --kernel NAME    auto, scalar, avx2 or avx512 (default auto)\n"
+              << "  --sliced-tail 0|1\n"
+              << "                   chain: finish on bit planes once every cell is below 8\n"
+              << "                   (default 1)\n"
+              << "  --warm-start D   pre-topple to density D, at least 3, 0: off\n"
+              << "  --odometer FILE  write per cell topple counts to FILE\n"
+              << "  --format NAME    final pile as snap (binary) or text (default snap)\n"
+              << "  --checkpoint FILE\n"
+              << "                   snapshot the pile to FILE while stabilizing\n"
+              << "  --checkpoint-interval S\n"
+              << "                   seconds between checkpoints (default 600)\n"
+              << "  --resume FILE    carry on from a snapshot, ignores --width and --grains\n"
+              << "  --stats FILE     append progress to FILE as JSON lines\n"
+              << "  --stats-interval S\n"
+              << "                   seconds between stats lines (default 1)\n"
+              << "  --frames FILE    time-lapse while stabilizing, chain and bands only:\n"
+              << "                   one FILE.y4m stream or numbered FILE.png/.bmp images\n"
+              << "  --frame-interval S\n"
+              << "                   seconds between frames (default 1)\n"
+              << "  --frame-topples N\n"
+              << "                   topplings between frames instead, N or 2^k\n"
+              << "  --drops N        then drop N single grains on the stable pile, N or 2^k\n"
+              << "  --drop-site NAME random or origin (default random)\n"
+              << "  --seed N         random drop sites from seed N (default 1)\n"
+              << "  --avalanches FILE\n"
+              << "                   avalanche histograms (default: next to the pile)\n"
+              << "  --sweep LIST     stabilize each grain count of LIST in turn, each from\n"
+              << "                   the last; LIST is counts and A..B ranges, which\n"
+              << "                   double from A up to B: 2^10..2^28,1000\n"
+              << "  --sweep-jobs K   split the counts over K sweeps run side by side,\n"
+              << "                   one thread and one pile each (default 1)\n"
+              << "  --profile FILE   per phase times, hardware counters and lock waits to\n"
+              << "                   FILE, needs a build with -DSANDPILE_PROFILE\n"
+              << "  --image NAME     picture of the pile as png, bmp or none (default png)\n"
+              << "  --pyramid NAME   deep zoom tiles of the pile, NAME.dzi and NAME_files/,\n"
+              << "                   for piles too large for one image; --resume a stable\n"
+              << "                   snapshot with --image none to tile it alone\n"
+              << "  --pyramid-downsample NAME\n"
+              << "                   zoomed out pixels by mode or mean height (default mode)\n"
+              << "  --view 0|1       show the pile in a window, needs -DUSE_SDL\n";
+}
+
+static bool parse_count(const std::string &text, unsigned long long &value) {
+    char *end;
+    if (text.compare(0, 2, "2^") == 0) {
+        unsigned long exponent = std::strtoul(text.c_str() + 2, &end, 10);
+        if (*end != '\0' or exponent > 63) return false;
+        value = 1ull << exponent;
+    } else {
+        value = std::strtoull(text.c_str(), &end, 10);
+        if (*end != '\0' or text.empty()) return false;
+    }
+    return true;
+}
+
+// comma separated counts and A..B ranges, sorted and without repeats
+static bool parse_grain_list(const std::string &text,
+                             std::vector<unsigned long long> &counts) {
+    std::size_t start = 0;
+    while (start <= text.size()) {
+        std::size_t comma = std::min(text.find(',', start), text.size());
+        std::string item = text.substr(start, comma - start);
+        std::size_t dots = item.find("..");
+        unsigned long long low, high;
+        if (dots == std::string::npos) {
+            if (not parse_count(item, low)) return false;
+            high = low;
+        } else if (not parse_count(item.substr(0, dots), low) or
+                   not parse_count(item.substr(dots + 2), high) or low == 0) {
+            return false;
+        }
+        if (high > 1ull << 48) return false;
+        for (unsigned long long grains = low; grains <= high; grains *= 2) {
+            counts.push_back(grains);
+            if (grains == 0) break;
+        }
+        start = comma + 1;
+    }
+    std::sort(counts.begin(), counts.end());
+    counts.erase(std::unique(counts.begin(), counts.end()), counts.end());
+    return not counts.empty();
+}
+
+bool parse_options(int argc, char **argv, options &opts) {
+    for (int k = 1; k < argc; k++) {
+        std::string name = argv[k];
+        if (k + 1 >= argc) {
+            usage(argv[0]);
+            return false;
+        }
+        std::string value = argv[++k];
+        unsigned long long count;
+        bool ok = true;
+        if (name == "--width") {
+            ok = value == "auto" or (parse_count(value, count) and
+                                     count > 0 and count <= 1u << 30);
+            opts.width = value == "auto" ? 0 : count;
+        } else if (name == "--max-width") {
+            ok = value == "auto" or (parse_count(value, count) and
+                                     count > 0 and count <= 1u << 30);
+            opts.max_width = value == "auto" ? 0 : count;
+        } else if (name == "--grains") {
+            ok = parse_count(value, opts.grains) and opts.grains <= 1ull << 48;
+        } else if (name == "--threads") {
+            ok = parse_count(value, count);
+            opts.threads = count;
+        } else if (name == "--engine") {
+            opts.engine = value;
+            ok = value == "chain" or value == "bands" or value == "tiles" or
+                 value == "processes" or value == "compact";
+        } else if (name == "--kernel") {
+            opts.kernel = value;
+        } else if (name == "--sliced-tail") {
+            opts.sliced_tail = value == "1";
+            ok = value == "0" or value == "1";
+        } else if (name == "--warm-start") {
+            char *end;
+            opts.warm_start = std::strtod(value.c_str(), &end);
+            // below 3 the start can overshoot the odometer
+            ok = *end == '\0' and (opts.warm_start == 0 or opts.warm_start >= 3);
+        } else if (name == "--odometer") {
+            opts.odometer = value;
+        } else if (name == "--format") {
+            opts.format = value;
+            ok = value == "snap" or value == "text";
+        } else if (name == "--checkpoint") {
+            opts.checkpoint = value;
+        } else if (name == "--checkpoint-interval") {
+            char *end;
+            opts.checkpoint_interval = std::strtod(value.c_str(), &end);
+            ok = *end == '\0' and opts.checkpoint_interval > 0;
+        } else if (name == "--resume") {
+            opts.resume = value;
+        } else if (name == "--stats") {
+            opts.stats = value;
+        } else if (name == "--stats-interval") {
+            char *end;
+            opts.stats_interval = std::strtod(value.c_str(), &end);
+            ok = *end == '\0' and opts.stats_interval > 0;
+        } else if (name == "--frames") {
+            opts.frames = value;
+        } else if (name == "--frame-interval") {
+            char *end;
+            opts.frame_interval = std::strtod(value.c_str(), &end);
+            ok = *end == '\0' and opts.frame_interval > 0;
+        } else if (name == "--frame-topples") {
+            ok = parse_count(value, opts.frame_topples);
+        } else if (name == "--drops") {
+            ok = parse_count(value, opts.drops);
+        } else if (name == "--drop-site") {
+            opts.drop_site = value;
+            ok = value == "random" or value == "origin";
+        } else if (name == "--seed") {
+            ok = parse_count(value, opts.seed);
+        } else if (name == "--avalanches") {
+            opts.avalanches = value;
+        } else if (name == "--sweep") {
+            opts.sweep.clear();
+            ok = parse_grain_list(value, opts.sweep);
+        } else if (name == "--sweep-jobs") {
+            ok = parse_count(value, count) and count > 0 and count <= 1024;
+            opts.sweep_jobs = count;
+        } else if (name == "--profile") {
+            opts.profile = value;
+        } else if (name == "--image") {
+            opts.image = value;
+            ok = value == "png" or value == "bmp" or value == "none";
+        } else if (name == "--pyramid") {
+            opts.pyramid = value;
+        } else if (name == "--pyramid-downsample") {
+            opts.pyramid_downsample = value;
+            ok = value == "mode" or value == "mean";
+        } else if (name == "--view") {
+            opts.view = value == "1";
+            ok = value == "0" or value == "1";
+        } else {
+            ok = false;
+        }
+        if (not ok) {
+            std::cout << "bad option " << name << " " << value << std::endl;
+            usage(argv[0]);
+            return false;
+        }
+    }
+    if (opts.threads <= 0) opts.threads = default_thread_count();
+    return true;
+}
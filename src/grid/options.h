@@ -0,0 +1,43 @@
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include <string>
+#include <vector>
+
+struct options {
+    int width = 600;                // 0: sized from the grain count
+    int max_width = -1;             // room to grow, -1: none, 0: sized from grains
+    unsigned long long grains = 1u << 21;
+    int threads = 0;                // 0: one per hardware thread
+    std::string engine = "chain";   // chain, bands, tiles, processes or compact
+    std::string kernel = "auto";
+    bool sliced_tail = true;        // chain: bit sliced sweeps once cells are below 8
+    double warm_start = 0;          // warm start density, at least 3, 0: off
+    std::string odometer;           // file for per cell topple counts
+    std::string format = "snap";    // final pile as a binary snap or as text
+    std::string checkpoint;         // file for periodic snapshots, empty: off
+    double checkpoint_interval = 600;   // seconds between checkpoints
+    std::string resume;             // snapshot to carry on from
+    std::string stats;              // file for progress as JSON lines, empty: off
+    double stats_interval = 1;      // seconds between stats lines
+    std::string frames;             // .y4m stream or .png/.bmp images, empty: off
+    double frame_interval = 1;      // seconds between frames
+    unsigned long long frame_topples = 0;   // topplings between frames, 0: by time
+    unsigned long long drops = 0;   // single grains dropped on the stable pile
+    std::string drop_site = "random";   // random or origin
+    unsigned long long seed = 1;
+    std::string avalanches;         // histogram file, empty: next to the pile
+    std::vector<unsigned long long> sweep;  // increasing grain counts, empty: off
+    int sweep_jobs = 1;             // independent sweeps run side by side
+    std::string profile;            // file for the phase profile, empty: off
+    std::string image = "png";      // png, bmp or none
+    std::string pyramid;            // base name of a deep zoom pyramid, empty: off
+    std::string pyramid_downsample = "mode";    // mode or mean
+    bool view = false;              // show the pile in an SDL window
+};
+
+// fills opts from --name value pairs, grain counts may be written as 2^k.
+// Prints usage and returns false on anything it does not understand.
+bool parse_options(int argc, char **argv, options &opts);
+
+#endif
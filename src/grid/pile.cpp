@@ -3,221 +3,344 @@
 #include <future>
 #include <mutex>
 #include <chrono>
+#include <algorithm>
+#include <cmath>
+#include "barrier.h"
+#include "snapshot.h"
+#include "frames.h"
+#include "profile.h"
 
 
-pile::pile(int N) {
-    N = std::max(N, 2);
-    nodes.resize(N);
-    j_range.resize(N);
-    i_range = N-1;
-    for (int i = 0; i < nodes.size(); i++) {
-        nodes[i].resize(N);
-        j_range[i] = 2;
-        for (int j = 0; j < nodes[i].size(); j++) {
-            nodes[i][j] = 0;
-        }
+pile::pile(int N, int capacity) :
+    nodes(std::max(N, 4), capacity),
+    kernel(select_kernel()) {
+    PROFILE_SCOPE("construction");
+    lay_out();
+}
+
+// sizes everything that follows the width; columns already there keep
+// their j_range, new ones start at 2
+void pile::lay_out() {
+    i_range = nodes.width - 1;
+    j_range.resize(nodes.width, 2);
+    // the narrowest columns are all sink past j = 1
+    for (int i = 0; i < nodes.width; i++) {
+        j_range[i] = std::min(j_range[i], nodes.length(i) - 1);
+    }
+    tile_offsets.resize(nodes.width + 1);
+    tile_offsets[0] = 0;
+    for (int i = 0; i < nodes.width; i++) {
+        tile_offsets[i+1] = tile_offsets[i] + (nodes.length(i) + tile-1) / tile;
+    }
+    dirty.assign(tile_offsets[nodes.width], 1);
+    if (not odometer.empty()) odometer.resize(nodes.size(), 0);
+}
+
+// Grains in the sink are still on the grid: widening turns the old sink
+// into ordinary cells that topple what they caught, and by the abelian
+// property the pile ends up as if it had been this wide all along.  Past
+// the frontier a wider grid costs little, as untouched cells are never
+// backed by memory and their tiles go clean after one sweep, so it grows
+// by a quarter at a time.
+bool pile::grow() {
+    int wider = nodes.width + std::max(tile, nodes.width / 4);
+    if (not nodes.grow(wider / tile * tile)) return false;
+    lay_out();
+    std::cout << "grew to " << nodes.width << " wide" << std::endl;
+    return true;
+}
+
+int width_for_grains(std::uint64_t grains) {
+    return std::ceil(std::sqrt(grains / (2 * M_PI))) + 2;
+}
+
+bool pile::can_grow() const {
+    return nodes.width < nodes.capacity;
+}
+
+void pile::add_grains(std::uint64_t grains) {
+    reservoir += grains;
+    release_reservoir();
+}
+
+// By the abelian property grains may join the origin at any time, so the
+// reservoir is released a chunk at a time as the origin sheds it.
+bool pile::release_reservoir() {
+    cell_t &origin = nodes(0, 0);
+    if (reservoir != 0 and origin < reservoir_chunk) {
+        cell_t released = std::min<std::uint64_t>(reservoir, reservoir_chunk - origin);
+        origin += released;
+        reservoir -= released;
+        dirty_column(0)[0] = 1;
     }
+    return reservoir != 0;
+}
+
+
+std::uint64_t pile::topple_range(int i, cell_t *left, cell_t *right, int lo, int hi) {
+    return topple_cells(i, nodes.column(i), left, right, odometer_column(i),
+                        lo, hi, kernel);
 }
 
+static void mark_tiles(unsigned char *dirty, int lo, int hi) {
+    if (dirty == nullptr) return;
+    for (int t = std::max(lo, 0) / pile::tile; t * pile::tile < hi; t++) {
+        dirty[t] = 1;
+    }
+}
 
-bool pile::stabilize_grid(std::vector<std::mutex> &column_guard) {
+// Sweeps the dirty tiles of column i.  A tile that toppled marks the tiles
+// of columns i-1 and i+1 it spilled into; a tile that had nothing to topple
+// is clean until a neighbour spills into it again.  left_dirty and
+// right_dirty may be nullptr when left and right are halo buffers.  What
+// the column did goes into tally.
+bool pile::topple_column(int i, cell_t *left, cell_t *right,
+                         unsigned char *left_dirty,
+                         unsigned char *right_dirty, sweep_tally &tally) {
+    unsigned char *dirty = dirty_column(i);
     bool done = true;
-    unsigned int spillover;
-    // i = 0 column
-    int i = 0;
-    int j = 0;
-    column_guard[0].lock();
-    column_guard[1].lock();
-    if (nodes[i][j] >= 4) {
-        done = false;
-        spillover = nodes[i][j] / 4;
-        nodes[i][j] = nodes[i][j] % 4;
-        // spills
-        nodes[i+1][j] += spillover;
-    }
-    j = 1;
-    if (nodes[i][j] >= 4) {
-        done = false;
-        spillover = nodes[i][j] / 4;
-        nodes[i][j] = nodes[i][j] % 4;
-        // spills
-        nodes[i+1][j] += spillover;
-        nodes[i+1][j-1] += 2*spillover;
-    }
-    for (j = 2; j < j_range[i]; j++) {
-        if (nodes[i][j] >= 4) {
+    // the last cell column i topples feeds the sink cell of column i+1
+    int edge = nodes.length(i) - 2;
+    cell_t sink_before = right[edge];
+    for (int t = 0; t * tile <= j_range[i]; t++) {
+        if (not dirty[t]) continue;
+        int lo = t * tile;
+        int hi = std::min(lo + tile, j_range[i]);
+        std::uint64_t topples = topple_range(i, left, right, lo, hi);
+        // check to expand j_range
+        int j = j_range[i];
+        if (j < lo + tile and nodes(i, j) >= 4 and j < nodes.length(i) - 1) {
+            j_range[i]++;
+            topples += topple_range(i, left, right, j, j+1);
+            hi = j+1;
+        }
+        if (topples != 0) {
             done = false;
-            spillover = nodes[i][j] / 4;
-            nodes[i][j] = nodes[i][j] % 4;
-            // spills
-            nodes[i+1][j-1] += spillover;
-            nodes[i+1][j] += spillover;
+            tally.topples += topples;
+            mark_tiles(left_dirty, lo, hi+1);
+            mark_tiles(right_dirty, lo-1, hi);
+        } else {
+            dirty[t] = 0;
         }
     }
-    // check to expand j_range
-    if (nodes[i][j_range[i]] >= 4 and j_range[i] < nodes[i].size() - 1) {
-        j = j_range[i]++;
-        done = false;
-        spillover = nodes[i][j] / 4;
-        nodes[i][j] = nodes[i][j] % 4;
-        // spills
-        nodes[i+1][j-1] += spillover;
-        nodes[i+1][j] += spillover;
-    }
-    // i = 1 column
-    i = 1;
-    j = 0;
-    column_guard[2].lock();
-    if (nodes[i][j] >= 4) {
-        done = false;
-        spillover = nodes[i][j] / 4;
-        nodes[i][j] = nodes[i][j] % 4;
-        // spills
-        nodes[i+1][j] += spillover;
-        nodes[i-1][j] += 4*spillover;
-        nodes[i-1][j+1] += 2*spillover;
-    }
-    j = 1;
-    if (nodes[i][j] >= 4) {
-        done = false;
-        spillover = nodes[i][j] / 4;
-        nodes[i][j] = nodes[i][j] % 4;
-        // spills
-        nodes[i+1][j] += spillover;
-        nodes[i-1][j] += 2*spillover;
-        nodes[i-1][j+1] += 2*spillover;
-        nodes[i+1][j-1] += 2*spillover;
-    }
-    for (j = 2; j < j_range[i]; j++) {
-        if (nodes[i][j] >= 4) {
-            done = false;
-            spillover = nodes[i][j] / 4;
-            nodes[i][j] = nodes[i][j] % 4;
-            // spills
-            nodes[i+1][j-1] += spillover;
-            nodes[i+1][j] += spillover;
-            nodes[i-1][j+1] += 2*spillover;
-            nodes[i-1][j] += 2*spillover;
+    tally.lost += (edge == 0 ? 4 : 8) * std::uint64_t(right[edge] - sink_before);
+    if (not done) tally.frontier = std::max(tally.frontier, i + j_range[i]);
+    tally.max_j_range = std::max(tally.max_j_range, j_range[i]);
+    return done;
+}
+
+void pile::enable_odometer() {
+    // room to grow into, which malloc only backs once it is used
+    odometer.reserve(nodes.offsets[nodes.capacity]);
+    odometer.assign(nodes.size(), 0);
+}
+
+void pile::mark_all_dirty() {
+    std::fill(dirty.begin(), dirty.end(), 1);
+}
+
+void pile::cover_grains() {
+    for (int i = 0; i < nodes.width; i++) {
+        int last = 0;
+        for (int j = 0; j < nodes.length(i); j++) {
+            if (nodes(i, j) != 0) last = j;
         }
+        j_range[i] = std::min(std::max(j_range[i], last + 1), nodes.length(i) - 1);
     }
-    // check to expand j_range
-    if (nodes[i][j_range[i]] >= 4 and j_range[i] < nodes[i].size() - 1) {
-        j = j_range[i]++;
-        done = false;
-        spillover = nodes[i][j] / 4;
-        nodes[i][j] = nodes[i][j] % 4;
-        // spills
-        nodes[i+1][j-1] += spillover;
-        nodes[i+1][j] += spillover;
-        nodes[i-1][j+1] += 2*spillover;
-        nodes[i-1][j] += 2*spillover;
-    }
-    // bulk
-    for (i = 2; i < i_range; i++) {
-        // bottom edge
-        j = 0;
+    mark_all_dirty();
+}
+
+// tiles past j_range or in the sink column may be marked but are never
+// swept, so they do not count
+int pile::active_tiles() const {
+    int count = 0;
+    for (int i = 0; i < i_range; i++) {
+        for (int t = 0; t * tile <= j_range[i]; t++) {
+            count += dirty[tile_offsets[i] + t];
+        }
+    }
+    return count;
+}
+
+bool pile::stabilize_grid(std::vector<std::mutex> &column_guard,
+                          sweep_tally &tally) {
+    bool done = true;
+    PROFILE_LOCK(column_guard[0]);
+    // the reservoir goes with column 0
+    if (reservoir != 0) done &= not release_reservoir();
+    PROFILE_LOCK(column_guard[1]);
+    done &= topple_column(0, nullptr, nodes.column(1),
+                          nullptr, dirty_column(1), tally);
+    PROFILE_LOCK(column_guard[2]);
+    done &= topple_column(1, nodes.column(0), nodes.column(2),
+                          dirty_column(0), dirty_column(2), tally);
+    for (int i = 2; i < i_range; i++) {
         column_guard[i-2].unlock();
         if (i+1 < i_range) {
-            column_guard[i+1].lock();
-        }
-        if (nodes[i][j] >= 4) {
-            done = false;
-            spillover = nodes[i][j] / 4;
-            nodes[i][j] = nodes[i][j] % 4;
-            // spills
-            nodes[i-1][j+1] += spillover;
-            nodes[i+1][j] += spillover;
-            nodes[i-1][j] += spillover;
-        }
-        j = 1;
-        if (nodes[i][j] >= 4) {
-            done = false;
-            spillover = nodes[i][j] / 4;
-            nodes[i][j] = nodes[i][j] % 4;
-            // spills
-            nodes[i-1][j+1] += spillover;
-            nodes[i+1][j-1] += 2*spillover;
-            nodes[i+1][j] += spillover;
-            nodes[i-1][j] += spillover;
-        }
-        for (j = 2; j < j_range[i]; j++) {
-            if (nodes[i][j] >= 4) {
-                done = false;
-                spillover = nodes[i][j] / 4;
-                nodes[i][j] = nodes[i][j] % 4;
-                // spills
-                nodes[i-1][j+1] += spillover;
-                nodes[i+1][j-1] += spillover;
-                nodes[i+1][j] += spillover;
-                nodes[i-1][j] += spillover;
-            }
-        }
-        // check to expand j_range
-        if (nodes[i][j_range[i]] >= 4 and j_range[i] < nodes[i].size() - 1) {
-            j = j_range[i]++;
-            done = false;
-            spillover = nodes[i][j] / 4;
-            nodes[i][j] = nodes[i][j] % 4;
-            // spills
-            nodes[i-1][j+1] += spillover;
-            nodes[i+1][j-1] += spillover;
-            nodes[i+1][j] += spillover;
-            nodes[i-1][j] += spillover;
+            PROFILE_LOCK(column_guard[i+1]);
         }
+        done &= topple_column(i, nodes.column(i-1), nodes.column(i+1),
+                              dirty_column(i-1), dirty_column(i+1), tally);
     }
     column_guard[i_range-2].unlock();
     column_guard[i_range-1].unlock();
     return done;
 }
 
-int pile::worker(std::vector<std::mutex> &column_guard) {
+int pile::worker(std::vector<std::mutex> &column_guard,
+                 std::atomic<int> &progress, int index) {
     bool done = false;
     int count = 0;
-    while (not done) {
-        done = stabilize_grid(std::ref(column_guard));
+    while (not done and not at_edge and not at_tail) {
+        sweep_tally tally;
+        {
+            PROFILE_SCOPE("sweep");
+            done = stabilize_grid(std::ref(column_guard), tally);
+        }
+        telemetry.publish(index, tally);
+        if (tally.lost != 0 and can_grow()) at_edge = true;
         count++;
+        progress++;
+        // worker 0 looks for the tail between its sweeps, when it holds no
+        // column; checkpoints and frames need the chain
+        if (index == 0 and count % 64 == 0 and sliced_tail and not done and
+            checkpoint == nullptr and frames == nullptr and
+            low_heights(column_guard)) {
+            at_tail = true;
+        }
     }
     return count;
 }
 
-int pile::check_grid(std::vector<std::mutex> &column_guard) {
-    int max_height = 0;
-    int n_squares = 0;
-    column_guard[0].lock();
-    for (int i = 0; i < nodes.size(); i++) {
-        int max_j = 0;
-        for (int j = 0; j < nodes[i].size(); j++) {
-            if (nodes[i][j] > max_height) {
-                max_height = nodes[i][j];
-            }
-            if (nodes[i][j] > 0) {
-                max_j = j;
+// Copies the grid column by column down the same lock chain the workers
+// use, so the copier can neither pass a worker nor be passed by one.  Every
+// toppling then lands either wholly before or wholly after the copy of the
+// columns it touches, and the copy is a pile the workers could have left
+// behind, which stabilizes to the same result.
+void pile::copy_grid(std::vector<std::mutex> &column_guard, snapshot &shot) {
+    PROFILE_SCOPE("copy");
+    PROFILE_LOCK(column_guard[0]);
+    shot.header.reservoir = reservoir;
+    for (int i = 0; i < nodes.width; i++) {
+        copy_column(shot, *this, i);
+        if (i+1 < nodes.width) {
+            PROFILE_LOCK(column_guard[i+1]);
+        }
+        column_guard[i].unlock();
+    }
+}
+
+// Whether the source has drained and every cell short of a sink is below
+// 8, down the lock chain like copy_grid.  The origin is the highest cell
+// while the source drains, so the rest is only looked at once it is low.
+// A clean tile had nothing to topple and nothing has spilled into it
+// since, so only the dirty tiles the sweeps still visit are read, and the
+// chain is let go at the first tall cell.
+bool pile::low_heights(std::vector<std::mutex> &column_guard) {
+    PROFILE_LOCK(column_guard[0]);
+    if (reservoir != 0 or nodes(0, 0) >= 8) {
+        column_guard[0].unlock();
+        return false;
+    }
+    for (int i = 0; i < nodes.width; i++) {
+        const cell_t *column = nodes.column(i);
+        const unsigned char *tiles = dirty_column(i);
+        int end = std::min(j_range[i] + 1, nodes.length(i) - 1);
+        for (int t = 0; t * tile < end; t++) {
+            if (not tiles[t]) continue;
+            for (int j = t * tile; j < std::min(t * tile + tile, end); j++) {
+                if (column[j] >= 8) {
+                    column_guard[i].unlock();
+                    return false;
+                }
             }
         }
-        n_squares += max_j;
-        if (i+1 < column_guard.size()) {
-            column_guard[i+1].lock();
+        if (i+1 < nodes.width) {
+            PROFILE_LOCK(column_guard[i+1]);
         }
         column_guard[i].unlock();
     }
-    std::cout << "num squares " << n_squares << std::endl;
-    return max_height;
+    return true;
+}
+
+void pile::checkpoint_grid(std::vector<std::mutex> &column_guard,
+                           std::uint64_t sweeps_so_far) {
+    snapshot shot = make_snapshot(*this);
+    shot.header.sweeps = sweeps_so_far;
+    copy_grid(column_guard, shot);
+    checkpoint->submit(std::move(shot));
+}
+
+// seconds and topples are what passed since the last frame
+bool pile::wants_frame(double seconds, std::uint64_t topples) {
+    if (frames == nullptr or not frames->ready()) return false;
+    return frame_topples != 0 ? topples >= frame_topples : seconds >= frame_interval;
+}
+
+// Runs the chain, growing and starting over whenever grains reach the sink
+// of a pile that still has room.
+int pile::stabilize(int num_threads) {
+    int count = run_chain(num_threads);
+    while (at_edge or at_tail) {
+        if (at_tail) {
+            count += run_sliced();
+            continue;
+        }
+        grow();
+        count += run_chain(num_threads);
+    }
+    return count;
 }
 
-void pile::stabilize() {
-    int num_threads(4);
+int pile::run_chain(int num_threads) {
     std::vector<std::future<int>> futures;
-    std::vector<std::mutex> column_guard(nodes.size());
+    std::vector<std::mutex> column_guard(nodes.width);
+    std::atomic<int> progress(0);
+    at_edge = false;
+    at_tail = false;
+    mark_all_dirty();
     for (int i = 0; i < num_threads; i++) {
-        futures.push_back(std::async(&pile::worker, this, 
-                          std::ref(column_guard)));
+        futures.push_back(std::async(&pile::worker, this,
+                          std::ref(column_guard), std::ref(progress), i));
     }
 
+    using namespace std::chrono;
+    auto last_checkpoint = steady_clock::now();
+    auto last_report = last_checkpoint;
+    auto last_frame = last_checkpoint;
+    std::uint64_t frame_mark = telemetry.read().topples;
+    // frames may be due more often than the progress lines
+    auto poll = milliseconds(200);
+    if (frames != nullptr and frame_topples == 0) {
+        poll = std::max(milliseconds(1), std::min(poll,
+                        duration_cast<milliseconds>(duration<double>(frame_interval))));
+    } else if (frames != nullptr) {
+        poll = milliseconds(10);
+    }
     std::future_status status;
     do {
-        status = futures[0].wait_for(std::chrono::milliseconds(200));
+        status = futures[0].wait_for(poll);
         if (status == std::future_status::timeout) {
-            std::cout << check_grid(std::ref(column_guard)) << std::endl;
+            telemetry_totals stats = telemetry.read();
+            auto now = steady_clock::now();
+            if (now - last_report >= milliseconds(200)) {
+                std::cout << stats.sweeps << " sweeps, " << stats.topples <<
+                             " topples, frontier " << stats.frontier << std::endl;
+                last_report = now;
+            }
+            if (checkpoint != nullptr and
+                now - last_checkpoint >= duration<double>(checkpoint_interval)) {
+                checkpoint_grid(column_guard, sweeps + progress);
+                last_checkpoint = now;
+            }
+            if (wants_frame(duration<double>(now - last_frame).count(),
+                          stats.topples - frame_mark)) {
+                snapshot shot = make_snapshot(*this, false);
+                copy_grid(column_guard, shot);
+                frames->submit(std::move(shot));
+                last_frame = now;
+                frame_mark = stats.topples;
+            }
         } else if (status == std::future_status::ready) {
             std::cout << "ready!\n";
         }
@@ -228,5 +351,176 @@ void pile::stabilize() {
         num_iterations += future.get();
     }
     std::cout << num_iterations << " total iterations" << std::endl;
+    sweeps += num_iterations;
+    return num_iterations;
 }
 
+
+
+// One contiguous range of columns per pool worker.  Spillover that leaves
+// a band goes into a halo buffer instead of the neighbouring band's column,
+// and the neighbour adds it in after the phase barrier.  Halos are double
+// buffered on the phase parity, so a band never writes into a halo that its
+// neighbour is still merging.
+struct band {
+    int lo, hi;
+    std::vector<cell_t> left_halo[2];   // spillover into column lo - 1
+    std::vector<cell_t> right_halo[2];  // spillover into column hi
+    int left_extent[2];
+    int right_extent[2];
+};
+
+void merge_halo(cell_t *halo, int extent, cell_t *column, unsigned char *dirty) {
+    for (int j = 0; j < extent; j++) {
+        if (halo[j] != 0) {
+            column[j] += halo[j];
+            halo[j] = 0;
+            dirty[j / pile::tile] = 1;
+        }
+    }
+}
+
+int pile::stabilize_bands(ThreadPool &pool) {
+    int count = run_bands(pool);
+    while (at_edge) {
+        grow();
+        count += run_bands(pool);
+    }
+    return count;
+}
+
+int pile::run_bands(ThreadPool &pool) {
+    int num_bands = std::max(1, std::min(pool.size(), i_range / 2));
+    std::vector<band> bands(num_bands);
+    for (int b = 0; b < num_bands; b++) {
+        band &own = bands[b];
+        own.lo = i_range * b / num_bands;
+        own.hi = i_range * (b+1) / num_bands;
+        for (int p = 0; p < 2; p++) {
+            if (b > 0) {
+                own.left_halo[p].resize(nodes.offsets[own.lo] -
+                                        nodes.offsets[own.lo-1]);
+            }
+            if (b+1 < num_bands) {
+                own.right_halo[p].resize(nodes.offsets[own.hi+1] -
+                                         nodes.offsets[own.hi]);
+            }
+            own.left_extent[p] = own.right_extent[p] = 0;
+        }
+    }
+
+    mark_all_dirty();
+    PhaseBarrier barrier(pool.size());
+    int phases = 0;
+    // set by worker 0 before the vote of a phase, read by everybody after
+    // it, so kept by phase parity like the halos
+    bool checkpoint_due[2] = {false, false};
+    bool frame_due[2] = {false, false};
+    // whether each band spilled into a sink it could grow past, written by
+    // its own band before the vote and read by everybody after it
+    std::vector<char> band_at_edge[2] = {std::vector<char>(pool.size(), 0),
+                                         std::vector<char>(pool.size(), 0)};
+    at_edge = false;
+    auto last_checkpoint = std::chrono::steady_clock::now();
+    auto last_frame = last_checkpoint;
+    std::uint64_t frame_mark = telemetry.read().topples;
+    pool.run([&](int b) {
+        bool all_done = false;
+        int phase = 0;
+        while (not all_done) {
+            int p = phase % 2;
+            bool done = true;
+            sweep_tally tally;
+            if (b < num_bands) {
+                PROFILE_SCOPE("band sweep");
+                band &own = bands[b];
+                if (b == 0 and reservoir != 0) done &= not release_reservoir();
+                for (int i = own.lo; i < own.hi; i++) {
+                    cell_t *left = nullptr;
+                    cell_t *right = nodes.column(i+1);
+                    unsigned char *left_dirty = nullptr;
+                    unsigned char *right_dirty = dirty_column(i+1);
+                    if (i == own.lo and b > 0) {
+                        left = own.left_halo[p].data();
+                    } else if (i > 0) {
+                        left = nodes.column(i-1);
+                        left_dirty = dirty_column(i-1);
+                    }
+                    if (i+1 == own.hi and b+1 < num_bands) {
+                        right = own.right_halo[p].data();
+                        right_dirty = nullptr;
+                    }
+                    done &= topple_column(i, left, right,
+                                          left_dirty, right_dirty, tally);
+                }
+                int extent_lo = std::min<int>(j_range[own.lo] + 2,
+                                              own.left_halo[p].size());
+                int extent_hi = std::min<int>(j_range[own.hi-1] + 2,
+                                              own.right_halo[p].size());
+                own.left_extent[p] = extent_lo;
+                own.right_extent[p] = extent_hi;
+            }
+            if (b == 0) {
+                auto now = std::chrono::steady_clock::now();
+                checkpoint_due[p] = checkpoint != nullptr and
+                    now - last_checkpoint >=
+                    std::chrono::duration<double>(checkpoint_interval);
+                if (checkpoint_due[p]) last_checkpoint = now;
+                std::uint64_t topples = frames ? telemetry.read().topples : 0;
+                frame_due[p] = wants_frame(
+                    std::chrono::duration<double>(now - last_frame).count(),
+                    topples - frame_mark);
+                if (frame_due[p]) {
+                    last_frame = now;
+                    frame_mark = topples;
+                }
+            }
+            // a phase is one sweep, counted by worker 0
+            telemetry.publish(b, tally, b == 0);
+            band_at_edge[p][b] = tally.lost != 0 and can_grow();
+            {
+                PROFILE_SCOPE("band barrier");
+                all_done = barrier.arrive_and_wait(done);
+            }
+            if (b < num_bands) {
+                PROFILE_SCOPE("halo merge");
+                band &own = bands[b];
+                if (b > 0) {
+                    band &prev = bands[b-1];
+                    merge_halo(prev.right_halo[p].data(), prev.right_extent[p],
+                               nodes.column(own.lo), dirty_column(own.lo));
+                }
+                if (b+1 < num_bands) {
+                    band &next = bands[b+1];
+                    merge_halo(next.left_halo[p].data(), next.left_extent[p],
+                               nodes.column(own.hi-1), dirty_column(own.hi-1));
+                }
+            }
+            phase++;
+            // with the halos merged the pile is whole and may be widened
+            if (not all_done and std::count(band_at_edge[p].begin(),
+                                            band_at_edge[p].end(), 1) != 0) {
+                if (b == 0) at_edge = true;
+                break;
+            }
+            // with the halos merged and nobody toppling, the grid is a
+            // whole pile: worker 0 copies it while the others hold still
+            if ((checkpoint_due[p] or frame_due[p]) and not all_done) {
+                barrier.arrive_and_wait(true);
+                if (b == 0 and checkpoint_due[p]) {
+                    snapshot shot = take_snapshot(*this);
+                    shot.header.sweeps = sweeps + phase;
+                    checkpoint->submit(std::move(shot));
+                }
+                if (b == 0 and frame_due[p]) {
+                    frames->submit(take_snapshot(*this, false));
+                }
+                barrier.arrive_and_wait(true);
+            }
+        }
+        if (b == 0) phases = phase;
+    });
+    std::cout << phases << " sweeps over " << num_bands << " bands" << std::endl;
+    sweeps += phases;
+    return phases;
+}
@@ -1,20 +1,113 @@
 #ifndef PILE_H
 #define PILE_H
 
+#include <atomic>
 #include <vector>
 #include <mutex>
+#include "octant.h"
+#include "kernel.h"
+#include "pool.h"
+#include "telemetry.h"
 
 struct pile;
+class SnapshotWriter;
+class FrameWriter;
+struct snapshot;
 
 struct pile {
-    std::vector<std::vector<unsigned int>> nodes;
+    octant nodes;
     std::vector<int> j_range;
     int i_range;
-    pile(int N);
-    void stabilize();
-    int worker(std::vector<std::mutex>&);
-    bool stabilize_grid(std::vector<std::mutex>&);
-    int check_grid(std::vector<std::mutex>&);
+    run_kernel kernel;
+    // every column is cut into tiles of tile cells, a tile is swept only
+    // while it is dirty
+    static constexpr int tile = 64;
+    // tiles of the asynchronous stabilizer span this many columns
+    static const int tile_columns = 16;
+    std::vector<int> tile_offsets;
+    std::vector<unsigned char> dirty;
+    // Grains waiting at the source.  Cells stay 32 bits however many grains
+    // are dropped: the origin holds at most reservoir_chunk of them and the
+    // stabilizers top it up from here whenever it runs low.  Heights near
+    // the origin then stay around the chunk, far below 2^32.
+    std::uint64_t reservoir = 0;
+    cell_t reservoir_chunk = 1u << 30;
+    // per cell topple counts, laid out like nodes; empty unless enabled
+    std::vector<std::uint64_t> odometer;
+    // sweeps done so far, including those before a restart
+    std::uint64_t sweeps = 0;
+    // while checkpoint is set the stabilizers hand it a consistent copy of
+    // the pile every checkpoint_interval seconds
+    SnapshotWriter *checkpoint = nullptr;
+    double checkpoint_interval = 600;
+    // while frames is set the chain and bands stabilizers hand it a copy of
+    // the pile every frame_interval seconds or, unless it is 0, every
+    // frame_topples topplings, whenever it is ready for one
+    FrameWriter *frames = nullptr;
+    double frame_interval = 1;
+    std::uint64_t frame_topples = 0;
+    // progress counters, readable at any time from any thread
+    Telemetry telemetry;
+    // set when grains reached the sink while the octant could still grow;
+    // the stabilizers then stop, grow and carry on
+    std::atomic<bool> at_edge{false};
+    // While set, the chain hands the pile over to the bit sliced sweeps of
+    // sliced.cpp once its source has drained and every cell is below 8,
+    // unless it takes checkpoints or frames.  at_tail is raised when it
+    // does, and stops the chain's workers.
+    bool sliced_tail = true;
+    std::atomic<bool> at_tail{false};
+    // a pile of width N that may grow up to capacity wide
+    pile(int N, int capacity = 0);
+    int stabilize(int num_threads = 4);
+    int stabilize_bands(ThreadPool &pool);
+    // asynchronous, tile by tile off work stealing queues; returns the
+    // number of tiles relaxed
+    int stabilize_tiles(ThreadPool &pool);
+    int run_chain(int num_threads);
+    int run_bands(ThreadPool &pool);
+    int run_tiles(ThreadPool &pool);
+    int run_processes(int num_processes);
+    int run_sliced();
+    // bands in num_processes worker processes, see procs.cpp; returns the
+    // number of phases, or -1 if a worker failed
+    int stabilize_processes(int num_processes);
+    // drops grains at the origin, the ones past the chunk into the reservoir
+    void add_grains(std::uint64_t grains);
+    // tops the origin up from the reservoir, returns whether any is left;
+    // only for whoever holds column 0
+    bool release_reservoir();
+    void lay_out();
+    bool grow();
+    bool can_grow() const;
+    int worker(std::vector<std::mutex>&, std::atomic<int>&, int index);
+    unsigned char *dirty_column(int i) { return dirty.data() + tile_offsets[i]; }
+    void enable_odometer();
+    std::uint64_t *odometer_column(int i) {
+        return odometer.empty() ? nullptr : odometer.data() + nodes.offsets[i];
+    }
+    void mark_all_dirty();
+    // widens j_range over every grain and marks all tiles dirty, for the
+    // sweeping engines to carry on from a pile filled some other way
+    void cover_grains();
+    int active_tiles() const;
+    std::uint64_t topple_range(int i, cell_t *left, cell_t *right, int lo, int hi);
+    bool topple_column(int i, cell_t *left, cell_t *right,
+                       unsigned char *left_dirty, unsigned char *right_dirty,
+                       sweep_tally &tally);
+    bool stabilize_grid(std::vector<std::mutex>&, sweep_tally &tally);
+    void copy_grid(std::vector<std::mutex>&, snapshot &shot);
+    bool low_heights(std::vector<std::mutex>&);
+    void checkpoint_grid(std::vector<std::mutex>&, std::uint64_t);
+    bool wants_frame(double seconds, std::uint64_t topples);
 };
 
+// adds the spillover a neighbouring band left in halo to column and marks
+// the tiles it lands in, zeroing halo for the next round
+void merge_halo(cell_t *halo, int extent, cell_t *column, unsigned char *dirty);
+
+// Width of an octant that holds grains dropped at the origin: the stable
+// pile fills a disc of density above 2, so this radius is an upper bound.
+int width_for_grains(std::uint64_t grains);
+
 #endif
@@ -0,0 +1,55 @@
+#include "pool.h"
+#include <algorithm>
+
+
+ThreadPool::ThreadPool(int num_threads) :
+    generation(0),
+    running(0),
+    not_done(true) {
+    for (int i = 0; i < std::max(num_threads, 1); i++) {
+        threads.push_back(std::thread(&ThreadPool::worker_loop, this, i));
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        not_done = false;
+    }
+    pool_cv.notify_all();
+    for (auto &thread: threads) {
+        thread.join();
+    }
+}
+
+void ThreadPool::worker_loop(int index) {
+    std::size_t seen = 0;
+    while (true) {
+        std::function<void(int)> fn;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            pool_cv.wait(lock, [this, seen] {
+                return generation != seen or not not_done;
+            });
+            if (not not_done) return;
+            seen = generation;
+            fn = job;
+        }
+        fn(index);
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--running == 0) keeper_cv.notify_one();
+    }
+}
+
+void ThreadPool::run(std::function<void(int)> fn) {
+    std::unique_lock<std::mutex> lock(mutex);
+    job = std::move(fn);
+    running = threads.size();
+    generation++;
+    pool_cv.notify_all();
+    keeper_cv.wait(lock, [this] { return running == 0; });
+}
+
+int default_thread_count() {
+    return std::max(1u, std::thread::hardware_concurrency());
+}
@@ -0,0 +1,36 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads that live as long as the pool.  run() hands
+// the same job to every worker, each called with its own worker index, and
+// returns once all of them have finished it.
+class ThreadPool {
+private:
+    std::mutex mutex;
+    std::condition_variable pool_cv;
+    std::condition_variable keeper_cv;
+    std::vector<std::thread> threads;
+    std::function<void(int)> job;
+    std::size_t generation;
+    std::size_t running;
+    bool not_done;
+    void worker_loop(int index);
+public:
+    explicit ThreadPool(int num_threads);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+    int size() const { return threads.size(); }
+    void run(std::function<void(int)> fn);
+};
+
+// number of workers to use when the command line does not say
+int default_thread_count();
+
+#endif
@@ -0,0 +1,358 @@
+#include "pile.h"
+#include "barrier.h"
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <string>
+#include <thread>
+
+// Bands in worker processes.  The launcher forks one worker per band, and
+// every worker topples its own columns in its own copy of the pile, as the
+// band stabilizer's threads do in a shared one.  Spillover across a band
+// edge goes through halo buffers in a POSIX shared memory segment, two per
+// edge and direction kept by phase parity, and the phase barrier doubles as
+// the termination vote.  Once everybody votes done the workers hand their
+// columns back through the segment and the launcher puts the pile together.
+// Workers that run into a sink the pile could grow past stop likewise, and
+// the launcher grows the pile and starts them over.  No checkpoints or
+// frames are taken in between.
+
+namespace {
+
+// What a band needs from the other bands.  shm_transport is the one for
+// processes on one machine; an MPI transport would send the halos and
+// their extents to the neighbouring ranks, reduce the vote with
+// MPI_Allreduce and gather the columns at rank 0.
+class band_transport {
+public:
+    virtual ~band_transport() = default;
+    // where band b leaves its spillover across side (0 left, 1 right) in
+    // phases of parity p
+    virtual cell_t *halo_out(int b, int side, int p) = 0;
+    // hands the first extent cells of that spillover over
+    virtual void send(int b, int side, int p, int extent) = 0;
+    // Phase barrier.  Returns true if every band is done; at_edge comes
+    // in as whether band b spilled into a sink the pile could grow past
+    // and goes out as whether any band did.
+    virtual bool vote(int b, int p, bool done, bool &at_edge) = 0;
+    // the neighbour's spillover into band b across side, after the vote
+    virtual cell_t *halo_in(int b, int side, int p, int &extent) = 0;
+    // band b's columns lo to hi - 1 and what is left at the source
+    virtual void gather(const pile &sandpile, int b, int lo, int hi) = 0;
+    virtual Telemetry &telemetry() = 0;
+};
+
+// the fixed part of the segment, the arrays follow it
+struct shm_header {
+    ProcessBarrier barrier;
+    Telemetry telemetry;
+    std::uint64_t reservoir;
+    int phases;
+    bool at_edge;
+    explicit shm_header(int bands) :
+        barrier(bands),
+        reservoir(0),
+        phases(0),
+        at_edge(false) { }
+};
+
+static std::size_t round_up(std::size_t bytes) {
+    return (bytes + octant::alignment - 1) / octant::alignment * octant::alignment;
+}
+
+// One anonymous POSIX shared memory segment, unlinked as soon as it is
+// mapped, so workers that die leave nothing behind in /dev/shm.
+class shm_transport : public band_transport {
+private:
+    int bands;
+    std::size_t bytes;
+    char *base;
+    shm_header *header;
+    int *extents;               // [band][side][parity]
+    char *edges;                // [parity][band]
+    std::vector<std::size_t> halos;     // byte offsets, [band][side][parity]
+    cell_t *cells;
+    std::uint64_t *odometer;    // nullptr unless the pile keeps one
+    int *j_ranges;
+    cell_t *halo(int b, int side, int p) {
+        return reinterpret_cast<cell_t*>(base + halos[(b * 2 + side) * 2 + p]);
+    }
+public:
+    shm_transport(const pile &sandpile, const std::vector<int> &cuts) :
+        bands(cuts.size() - 1),
+        bytes(0),
+        base(nullptr),
+        halos(bands * 4, 0) {
+        const octant &nodes = sandpile.nodes;
+        std::size_t at = round_up(sizeof(shm_header));
+        std::size_t extents_at = at;
+        at += round_up(bands * 4 * sizeof(int));
+        std::size_t edges_at = at;
+        at += round_up(2 * bands);
+        for (int b = 0; b < bands; b++) {
+            for (int p = 0; p < 2; p++) {
+                if (b > 0) {
+                    halos[(b * 2) * 2 + p] = at;
+                    at += round_up(nodes.length(cuts[b] - 1) * sizeof(cell_t));
+                }
+                if (b + 1 < bands) {
+                    halos[(b * 2 + 1) * 2 + p] = at;
+                    at += round_up(nodes.length(cuts[b+1]) * sizeof(cell_t));
+                }
+            }
+        }
+        std::size_t cells_at = at;
+        at += round_up(nodes.size() * sizeof(cell_t));
+        std::size_t odometer_at = at;
+        if (not sandpile.odometer.empty()) {
+            at += round_up(nodes.size() * sizeof(std::uint64_t));
+        }
+        std::size_t j_ranges_at = at;
+        at += round_up(nodes.width * sizeof(int));
+
+        static std::atomic<int> segments{0};
+        std::string name = "/sandpile-" + std::to_string(getpid()) + "-" +
+                           std::to_string(segments++);
+        int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd < 0) {
+            std::cout << "cannot open shared memory " << name << ": " <<
+                         std::strerror(errno) << std::endl;
+            return;
+        }
+        shm_unlink(name.c_str());
+        void *mapped = MAP_FAILED;
+        if (ftruncate(fd, at) == 0) {
+            mapped = mmap(nullptr, at, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        }
+        if (mapped == MAP_FAILED) {
+            std::cout << "cannot map " << at << " bytes of shared memory: " <<
+                         std::strerror(errno) << std::endl;
+            close(fd);
+            return;
+        }
+        close(fd);
+        bytes = at;
+        base = static_cast<char*>(mapped);
+        // the segment starts out zero, which is what the halos need
+        header = new (base) shm_header(bands);
+        extents = reinterpret_cast<int*>(base + extents_at);
+        edges = base + edges_at;
+        cells = reinterpret_cast<cell_t*>(base + cells_at);
+        odometer = sandpile.odometer.empty() ? nullptr :
+                   reinterpret_cast<std::uint64_t*>(base + odometer_at);
+        j_ranges = reinterpret_cast<int*>(base + j_ranges_at);
+    }
+    ~shm_transport() {
+        // no destructors: pthread_cond_destroy waits for the waiters of a
+        // worker that was killed at the barrier, and unmapping is enough
+        if (base != nullptr) munmap(base, bytes);
+    }
+    shm_transport(const shm_transport &) = delete;
+    shm_transport &operator=(const shm_transport &) = delete;
+    bool good() const { return base != nullptr; }
+    cell_t *halo_out(int b, int side, int p) override {
+        return halo(b, side, p);
+    }
+    void send(int b, int side, int p, int extent) override {
+        extents[(b * 2 + side) * 2 + p] = extent;
+    }
+    bool vote(int b, int p, bool done, bool &at_edge) override {
+        edges[p * bands + b] = at_edge;
+        bool all_done = header->barrier.arrive_and_wait(done);
+        at_edge = std::count(edges + p * bands, edges + (p+1) * bands, 1) != 0;
+        return all_done;
+    }
+    cell_t *halo_in(int b, int side, int p, int &extent) override {
+        int from = side == 0 ? b - 1 : b + 1;
+        extent = extents[(from * 2 + 1 - side) * 2 + p];
+        return halo(from, 1 - side, p);
+    }
+    void gather(const pile &sandpile, int b, int lo, int hi) override {
+        const octant &nodes = sandpile.nodes;
+        std::copy(nodes.column(lo), nodes.column(hi), cells + nodes.offsets[lo]);
+        if (odometer != nullptr) {
+            std::copy(sandpile.odometer.begin() + nodes.offsets[lo],
+                      sandpile.odometer.begin() + nodes.offsets[hi],
+                      odometer + nodes.offsets[lo]);
+        }
+        std::copy(sandpile.j_range.begin() + lo, sandpile.j_range.begin() + hi,
+                  j_ranges + lo);
+        if (b == 0) header->reservoir = sandpile.reservoir;
+    }
+    Telemetry &telemetry() override { return header->telemetry; }
+    // for the launcher once the workers are gone
+    const shm_header &totals() const { return *header; }
+    void set_phases(int phases, bool at_edge) {
+        header->phases = phases;
+        header->at_edge = at_edge;
+    }
+    void scatter(pile &sandpile) const {
+        octant &nodes = sandpile.nodes;
+        std::copy(cells, cells + nodes.size(), nodes.column(0));
+        if (odometer != nullptr) {
+            std::copy(odometer, odometer + nodes.size(), sandpile.odometer.begin());
+        }
+        std::copy(j_ranges, j_ranges + nodes.width, sandpile.j_range.begin());
+        sandpile.reservoir = header->reservoir;
+    }
+};
+
+// The band loop of pile::run_bands for band b of a worker process, with
+// the transport in place of the shared halos and barrier.
+int run_band(pile &sandpile, band_transport &net, int b, int num_bands,
+             int lo, int hi, bool &at_edge) {
+    octant &nodes = sandpile.nodes;
+    bool all_done = false;
+    int phase = 0;
+    at_edge = false;
+    while (not all_done) {
+        int p = phase % 2;
+        bool done = true;
+        sweep_tally tally;
+        if (b == 0 and sandpile.reservoir != 0) done &= not sandpile.release_reservoir();
+        for (int i = lo; i < hi; i++) {
+            cell_t *left = nullptr;
+            cell_t *right = nodes.column(i+1);
+            unsigned char *left_dirty = nullptr;
+            unsigned char *right_dirty = sandpile.dirty_column(i+1);
+            if (i == lo and b > 0) {
+                left = net.halo_out(b, 0, p);
+            } else if (i > 0) {
+                left = nodes.column(i-1);
+                left_dirty = sandpile.dirty_column(i-1);
+            }
+            if (i+1 == hi and b+1 < num_bands) {
+                right = net.halo_out(b, 1, p);
+                right_dirty = nullptr;
+            }
+            done &= sandpile.topple_column(i, left, right,
+                                           left_dirty, right_dirty, tally);
+        }
+        if (b > 0) {
+            net.send(b, 0, p, std::min(sandpile.j_range[lo] + 2, nodes.length(lo-1)));
+        }
+        if (b+1 < num_bands) {
+            net.send(b, 1, p, std::min(sandpile.j_range[hi-1] + 2, nodes.length(hi)));
+        }
+        net.telemetry().publish(b, tally, b == 0);
+        at_edge = tally.lost != 0 and sandpile.can_grow();
+        all_done = net.vote(b, p, done, at_edge);
+        int extent;
+        if (b > 0) {
+            cell_t *halo = net.halo_in(b, 0, p, extent);
+            merge_halo(halo, extent, nodes.column(lo), sandpile.dirty_column(lo));
+        }
+        if (b+1 < num_bands) {
+            cell_t *halo = net.halo_in(b, 1, p, extent);
+            merge_halo(halo, extent, nodes.column(hi-1), sandpile.dirty_column(hi-1));
+        }
+        phase++;
+        // with the halos merged the pile is whole and may be widened
+        if (not all_done and at_edge) break;
+    }
+    if (all_done) at_edge = false;
+    return phase;
+}
+
+}
+
+int pile::stabilize_processes(int num_processes) {
+    int count = run_processes(num_processes);
+    while (at_edge and count >= 0) {
+        grow();
+        int more = run_processes(num_processes);
+        count = more < 0 ? more : count + more;
+    }
+    return count;
+}
+
+int pile::run_processes(int num_processes) {
+    int num_bands = std::max(1, std::min(num_processes, i_range / 2));
+    std::vector<int> cuts(num_bands + 1);
+    for (int b = 0; b <= num_bands; b++) cuts[b] = i_range * b / num_bands;
+    shm_transport net(*this, cuts);
+    if (not net.good()) return -1;
+    at_edge = false;
+    mark_all_dirty();
+
+    // nothing buffered may be written twice, once by a worker
+    std::cout.flush();
+    std::vector<pid_t> workers;
+    for (int b = 0; b < num_bands; b++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            bool edge;
+            int phases = run_band(*this, net, b, num_bands, cuts[b], cuts[b+1], edge);
+            // the last band also hands in the sink column past it
+            net.gather(*this, b, cuts[b], b+1 == num_bands ? nodes.width : cuts[b+1]);
+            if (b == 0) net.set_phases(phases, edge);
+            _exit(0);
+        }
+        if (pid < 0) {
+            std::cout << "cannot start worker process: " << std::strerror(errno) << std::endl;
+            break;
+        }
+        workers.push_back(pid);
+    }
+
+    // reaps the workers and reports progress; a worker that fails takes
+    // the rest with it, as they would wait for it at the barrier forever
+    using namespace std::chrono;
+    bool failed = (int)workers.size() != num_bands;
+    std::size_t running = workers.size();
+    auto last_report = steady_clock::now();
+    telemetry_totals published;
+    while (running != 0) {
+        for (pid_t &pid : workers) {
+            int status;
+            if (pid == 0 or waitpid(pid, &status, WNOHANG) != pid) continue;
+            if (not WIFEXITED(status) or WEXITSTATUS(status) != 0) failed = true;
+            pid = 0;
+            running--;
+        }
+        if (failed) {
+            for (pid_t pid : workers) {
+                if (pid != 0) kill(pid, SIGKILL);
+            }
+            for (pid_t pid : workers) {
+                if (pid != 0) waitpid(pid, nullptr, 0);
+            }
+            std::cout << "a worker process failed, the pile is as it was" << std::endl;
+            return -1;
+        }
+        // the workers' counters show up in the pile's own as they come
+        telemetry_totals stats = net.telemetry().read();
+        sweep_tally tally;
+        tally.topples = stats.topples - published.topples;
+        tally.lost = stats.lost - published.lost;
+        tally.frontier = stats.frontier;
+        tally.max_j_range = stats.max_j_range;
+        telemetry.publish(0, tally, stats.sweeps - published.sweeps);
+        published = stats;
+        if (running == 0) break;
+        auto now = steady_clock::now();
+        if (now - last_report >= milliseconds(200)) {
+            std::cout << stats.sweeps << " sweeps, " << stats.topples <<
+                         " topples, frontier " << stats.frontier << std::endl;
+            last_report = now;
+        }
+        std::this_thread::sleep_for(milliseconds(5));
+    }
+
+    net.scatter(*this);
+    mark_all_dirty();
+    at_edge = net.totals().at_edge;
+    int phases = net.totals().phases;
+    std::cout << phases << " sweeps over " << num_bands << " processes" << std::endl;
+    sweeps += phases;
+    return phases;
+}
@@ -0,0 +1,219 @@
+#include "profile.h"
+#include <iostream>
+
+#ifdef SANDPILE_PROFILE
+
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <utility>
+#include <vector>
+
+static const int counters = 4;
+static const char *counter_names[counters] = {
+    "cycles", "instructions", "llc misses", "branch misses"};
+static const std::uint64_t counter_configs[counters] = {
+    PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+
+struct phase_total {
+    std::uint64_t calls = 0;
+    std::uint64_t ns = 0;
+    std::uint64_t counts[counters] = {};
+};
+
+static std::atomic<bool> recording{false};
+static std::atomic<bool> have_counters{false};
+static std::atomic<bool> counters_failed{false};
+static std::atomic<int> next_thread{0};
+static std::mutex registry_mutex;
+// by phase and thread
+static std::map<std::pair<std::string, int>, phase_total> registry;
+// waits in power of two nanosecond bins, bin 0 for locks taken at once
+static std::atomic<std::uint64_t> lock_waits[65];
+
+static std::uint64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// The calling thread's counters, one perf event group led by cycles, so
+// all four are read at once and stay comparable.
+struct thread_counters {
+    int index;
+    int fds[counters];
+    bool open;
+    thread_counters() : index(next_thread++), open(false) {
+        std::fill(fds, fds + counters, -1);
+        for (int k = 0; k < counters; k++) {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = counter_configs[k];
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP;
+            fds[k] = syscall(SYS_perf_event_open, &attr, 0, -1,
+                             k == 0 ? -1 : fds[0], 0);
+            if (fds[k] < 0) {
+                if (not counters_failed.exchange(true)) {
+                    std::cout << "no hardware counters, timing only: " <<
+                                 std::strerror(errno) << std::endl;
+                }
+                close_all();
+                return;
+            }
+        }
+        open = true;
+        have_counters = true;
+    }
+    ~thread_counters() { close_all(); }
+    void close_all() {
+        for (int &fd : fds) {
+            if (fd >= 0) ::close(fd);
+            fd = -1;
+        }
+        open = false;
+    }
+    void read(std::uint64_t *values) {
+        std::uint64_t group[1 + counters] = {};
+        if (not open or ::read(fds[0], group, sizeof(group)) != sizeof(group)) {
+            std::fill(values, values + counters, 0);
+            return;
+        }
+        std::copy(group + 1, group + 1 + counters, values);
+    }
+};
+
+static thread_local thread_counters self;
+
+profile_scope::profile_scope(const char *phase) :
+    phase(phase),
+    active(recording) {
+    if (not active) return;
+    self.read(start_counts);
+    start_ns = now_ns();
+}
+
+profile_scope::~profile_scope() {
+    if (not active) return;
+    std::uint64_t ns = now_ns() - start_ns;
+    std::uint64_t counts[counters];
+    self.read(counts);
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    phase_total &total = registry[std::make_pair(std::string(phase), self.index)];
+    total.calls++;
+    total.ns += ns;
+    for (int k = 0; k < counters; k++) total.counts[k] += counts[k] - start_counts[k];
+}
+
+void profile_lock(std::mutex &mutex) {
+    if (not recording) {
+        mutex.lock();
+        return;
+    }
+    if (mutex.try_lock()) {
+        lock_waits[0].fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    std::uint64_t start = now_ns();
+    mutex.lock();
+    std::uint64_t wait = now_ns() - start;
+    int bin = wait == 0 ? 1 : 64 - __builtin_clzll(wait);
+    lock_waits[bin].fetch_add(1, std::memory_order_relaxed);
+}
+
+bool profile_available() {
+    return true;
+}
+
+bool profile_start() {
+    recording = true;
+    return true;
+}
+
+static void report_line(std::ostream &out, const std::string &phase,
+                        const std::string &thread, const phase_total &total) {
+    out << std::left << std::setw(18) << phase << std::setw(8) << thread <<
+           std::right << std::setw(10) << total.calls <<
+           std::setw(12) << std::fixed << std::setprecision(3) << total.ns * 1e-9 <<
+           std::setw(14) << std::setprecision(4) << total.ns * 1e-6 / total.calls;
+    if (have_counters) {
+        for (int k = 0; k < counters; k++) out << std::setw(16) << total.counts[k];
+        out << std::setw(8) << std::setprecision(2) <<
+               (total.counts[0] ? double(total.counts[1]) / total.counts[0] : 0.0);
+    }
+    out << "\n";
+}
+
+bool write_profile(const std::string &path) {
+    std::ostringstream out;
+    out << std::left << std::setw(18) << "phase" << std::setw(8) << "thread" <<
+           std::right << std::setw(10) << "calls" << std::setw(12) << "seconds" <<
+           std::setw(14) << "ms per call";
+    if (have_counters) {
+        for (const char *name : counter_names) out << std::setw(16) << name;
+        out << std::setw(8) << "IPC";
+    }
+    out << "\n";
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        // all threads of a phase, then each thread if more than one
+        auto it = registry.begin();
+        while (it != registry.end()) {
+            auto end = it;
+            phase_total sum;
+            int threads = 0;
+            for (; end != registry.end() and end->first.first == it->first.first; ++end) {
+                sum.calls += end->second.calls;
+                sum.ns += end->second.ns;
+                for (int k = 0; k < counters; k++) sum.counts[k] += end->second.counts[k];
+                threads++;
+            }
+            report_line(out, it->first.first, "all", sum);
+            for (; threads > 1 and it != end; ++it) {
+                report_line(out, "", std::to_string(it->first.second), it->second);
+            }
+            it = end;
+        }
+    }
+    out << "lock waits\n";
+    out << "  uncontended      " << lock_waits[0] << "\n";
+    for (int bin = 1; bin < 65; bin++) {
+        if (lock_waits[bin] == 0) continue;
+        out << "  < 2^" << std::left << std::setw(2) << bin << " ns       " <<
+               std::right << lock_waits[bin] << "\n";
+    }
+    std::cout << out.str();
+    std::ofstream file(path);
+    file << out.str();
+    if (not file) std::cout << "cannot write profile to " << path << std::endl;
+    return bool(file);
+}
+
+#else
+
+bool profile_available() {
+    return false;
+}
+
+bool profile_start() {
+    std::cout << "built without profiling, --profile needs -DSANDPILE_PROFILE" << std::endl;
+    return false;
+}
+
+bool write_profile(const std::string &) {
+    return false;
+}
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+// Profiling build, compiled in with -DSANDPILE_PROFILE and switched on at
+// run time with --profile.  PROFILE_SCOPE("name") charges the rest of the
+// enclosing block to phase name: wall time and, where the kernel lets us
+// open them, the calling thread's cycles, instructions, last level cache
+// misses and branch misses from perf_event_open.  PROFILE_LOCK(m) locks m
+// and adds the wait to a histogram.  Without the define both expand to
+// nothing but the plain lock, so the regular build pays nothing.
+
+#ifdef SANDPILE_PROFILE
+
+class profile_scope {
+private:
+    const char *phase;
+    std::uint64_t start_ns;
+    std::uint64_t start_counts[4];
+    bool active;
+public:
+    explicit profile_scope(const char *phase);
+    ~profile_scope();
+    profile_scope(const profile_scope &) = delete;
+    profile_scope &operator=(const profile_scope &) = delete;
+};
+
+void profile_lock(std::mutex &mutex);
+
+#define PROFILE_JOIN2(a, b) a##b
+#define PROFILE_JOIN(a, b) PROFILE_JOIN2(a, b)
+#define PROFILE_SCOPE(phase) profile_scope PROFILE_JOIN(profile_scope_, __LINE__)(phase)
+#define PROFILE_LOCK(mutex) profile_lock(mutex)
+
+#else
+
+#define PROFILE_SCOPE(phase) do { } while (0)
+#define PROFILE_LOCK(mutex) (mutex).lock()
+
+#endif
+
+// whether this build can profile
+bool profile_available();
+// starts recording; false, with a note, in builds without SANDPILE_PROFILE
+bool profile_start();
+// Per phase and per thread totals, per call averages and the lock wait
+// histogram, as text.  Also printed to stdout.
+bool write_profile(const std::string &path);
+
+#endif
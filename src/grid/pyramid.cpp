@@ -0,0 +1,253 @@
+#include "pyramid.h"
+#include "profile.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+
+namespace {
+
+// A tile of a level as height counts, classes of them to a pixel, or for
+// the full image just the heights, clamped to the last class.
+struct tile_counts {
+    int columns;
+    int rows;
+    std::vector<std::uint64_t> counts;
+    std::vector<unsigned char> heights;
+};
+
+typedef std::function<void(int level, int x, int y, const tile_counts &tile)> tile_sink;
+
+// mean heights are drawn in this many steps from one color to the next
+int mean_steps(int classes) {
+    return std::min(16, 255 / std::max(1, classes - 1));
+}
+
+}
+
+tile_pyramid::tile_pyramid(int width, const span_source &spans, bool mode,
+                           int tile_size, const palette &colors) :
+    width(width),
+    side(2 * width - 1),
+    levels(1),
+    tile_size(tile_size),
+    mode(mode),
+    colors(colors),
+    spans(spans) {
+    while ((1 << (levels - 1)) < side) levels++;
+}
+
+int tile_pyramid::level_side(int level) const {
+    int shift = levels - 1 - level;
+    return (side + (1 << shift) - 1) >> shift;
+}
+
+int tile_pyramid::tiles_across(int level) const {
+    return (level_side(level) + tile_size - 1) / tile_size;
+}
+
+palette tile_pyramid::tile_palette() const {
+    if (mode) return colors;
+    int steps = mean_steps(colors.size);
+    palette blended;
+    std::fill(blended.colors, blended.colors + 256, colors.colors[colors.size - 1]);
+    blended.size = (colors.size - 1) * steps + 1;
+    for (int k = 0; k < blended.size; k++) {
+        std::uint32_t low = colors.colors[k / steps];
+        std::uint32_t high = colors.colors[std::min(k / steps + 1, colors.size - 1)];
+        int t = k % steps;
+        std::uint32_t color = 0;
+        for (int shift = 0; shift < 32; shift += 8) {
+            int a = low >> shift & 0xff, b = high >> shift & 0xff;
+            color |= std::uint32_t((a * (steps - t) + b * t + steps / 2) / steps) << shift;
+        }
+        blended.colors[k] = color;
+    }
+    return blended;
+}
+
+namespace {
+
+// Adds the counts of child, at (dx, dy) of the four under tile, to the
+// tile: pixel (u, v) of the child is under (dx size + u) / 2 of it.
+void add_child(tile_counts &tile, const tile_counts &child, int dx, int dy,
+               int size, int classes) {
+    if (not child.heights.empty()) {
+        for (int v = 0; v < child.rows; v++) {
+            std::uint64_t *to = tile.counts.data() +
+                (std::size_t)((dy * size + v) / 2) * tile.columns * classes;
+            const unsigned char *from = child.heights.data() + (std::size_t)v * child.columns;
+            for (int u = 0; u < child.columns; u++) {
+                to[(dx * size + u) / 2 * classes + from[u]]++;
+            }
+        }
+        return;
+    }
+    for (int v = 0; v < child.rows; v++) {
+        for (int u = 0; u < child.columns; u++) {
+            const std::uint64_t *from = child.counts.data() +
+                ((std::size_t)v * child.columns + u) * classes;
+            std::uint64_t *to = tile.counts.data() +
+                ((std::size_t)((dy * size + v) / 2) * tile.columns +
+                 (dx * size + u) / 2) * classes;
+            for (int k = 0; k < classes; k++) to[k] += from[k];
+        }
+    }
+}
+
+// an empty tile (x, y) of level
+tile_counts empty_tile(const tile_pyramid &pyramid, int level, int x, int y) {
+    int size = pyramid.tile_size;
+    tile_counts tile;
+    tile.columns = std::min(size, pyramid.level_side(level) - x * size);
+    tile.rows = std::min(size, pyramid.level_side(level) - y * size);
+    std::size_t pixels = (std::size_t)tile.columns * tile.rows;
+    if (level == pyramid.levels - 1) {
+        tile.heights.assign(pixels, 0);
+    } else {
+        tile.counts.assign(pixels * pyramid.colors.size, 0);
+    }
+    return tile;
+}
+
+// Makes tile (x, y) of level of pyramid, and first every tile below it,
+// handing each one to sink once it is done.
+tile_counts count_tile(const tile_pyramid &pyramid, int level, int x, int y,
+                       const tile_sink &sink) {
+    int classes = pyramid.colors.size;
+    int size = pyramid.tile_size;
+    tile_counts tile = empty_tile(pyramid, level, x, y);
+    if (level == pyramid.levels - 1) {
+        PROFILE_SCOPE("pyramid cells");
+        // unfolds the plane: column c and row r are at |c - (width - 1)|
+        // and |r - (width - 1)| in the quadrant the octant mirrors to
+        int centre = pyramid.width - 1;
+        int c0 = x * size, c1 = c0 + tile.columns - 1;
+        int ax0 = c0 > centre ? c0 - centre : c1 < centre ? centre - c1 : 0;
+        int ax1 = std::max(std::abs(c0 - centre), std::abs(c1 - centre));
+        std::vector<unsigned char> span(ax1 - ax0 + 1);
+        for (int v = 0; v < tile.rows; v++) {
+            pyramid.spans(std::abs(y * size + v - centre), ax0, span.size(), span.data());
+            unsigned char *row = tile.heights.data() + (std::size_t)v * tile.columns;
+            for (int u = 0; u < tile.columns; u++) {
+                row[u] = std::min<int>(span[std::abs(c0 + u - centre) - ax0], classes - 1);
+            }
+        }
+    } else {
+        for (int dy = 0; dy < 2; dy++) {
+            for (int dx = 0; dx < 2; dx++) {
+                int cx = 2 * x + dx, cy = 2 * y + dy;
+                if (cx >= pyramid.tiles_across(level + 1) or
+                    cy >= pyramid.tiles_across(level + 1)) continue;
+                add_child(tile, count_tile(pyramid, level + 1, cx, cy, sink),
+                          dx, dy, size, classes);
+            }
+        }
+    }
+    sink(level, x, y, tile);
+    return tile;
+}
+
+// palette indices of the tile, see tile_pyramid::tile_palette
+std::vector<unsigned char> draw_tile(const tile_pyramid &pyramid, const tile_counts &tile) {
+    int classes = pyramid.colors.size;
+    int steps = mean_steps(classes);
+    std::vector<unsigned char> indices((std::size_t)tile.columns * tile.rows);
+    if (not tile.heights.empty()) {
+        for (std::size_t p = 0; p < indices.size(); p++) {
+            indices[p] = pyramid.mode ? tile.heights[p] : tile.heights[p] * steps;
+        }
+        return indices;
+    }
+    for (std::size_t p = 0; p < indices.size(); p++) {
+        const std::uint64_t *counts = tile.counts.data() + p * classes;
+        if (pyramid.mode) {
+            indices[p] = std::max_element(counts, counts + classes) - counts;
+        } else {
+            std::uint64_t total = 0, sum = 0;
+            for (int k = 0; k < classes; k++) {
+                total += counts[k];
+                sum += k * counts[k];
+            }
+            indices[p] = (sum * steps + total / 2) / total;
+        }
+    }
+    return indices;
+}
+
+}
+
+std::vector<unsigned char> tile_pyramid::tile(int level, int x, int y) const {
+    return draw_tile(*this, count_tile(*this, level, x, y,
+                                       [](int, int, int, const tile_counts&) {}));
+}
+
+bool tile_pyramid::write(const std::string &base, ThreadPool &pool) const {
+    PROFILE_SCOPE("pyramid");
+    std::string folder = base + "_files";
+    std::error_code error;
+    for (int level = 0; level < levels; level++) {
+        std::filesystem::create_directories(folder + "/" + std::to_string(level), error);
+        if (error) {
+            std::cout << "cannot make " << folder << ": " << error.message() << std::endl;
+            return false;
+        }
+    }
+    std::ofstream dzi(base + ".dzi");
+    dzi << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+           "<Image xmlns=\"http://schemas.microsoft.com/deepzoom/2008\"\n"
+           "       Format=\"png\" Overlap=\"0\" TileSize=\"" << tile_size << "\">\n"
+           "    <Size Width=\"" << side << "\" Height=\"" << side << "\"/>\n"
+           "</Image>\n";
+    dzi.close();
+    if (not dzi) {
+        std::cout << "writing " << base << ".dzi failed" << std::endl;
+        return false;
+    }
+
+    palette drawn = tile_palette();
+    std::atomic<bool> ok{true};
+    std::atomic<std::uint64_t> written{0};
+    tile_sink sink = [&](int level, int x, int y, const tile_counts &tile) {
+        std::string path = folder + "/" + std::to_string(level) + "/" +
+                           std::to_string(x) + "_" + std::to_string(y) + ".png";
+        if (not write_indexed_png(path, tile.columns, tile.rows,
+                                  draw_tile(*this, tile).data(), drawn)) ok = false;
+        written++;
+    };
+
+    // The workers take whole trees of tiles from the first level with a
+    // tree each; the few levels above are made from the trees' tops.
+    int split = 0;
+    while (split < levels - 1 and
+           (std::int64_t)tiles_across(split) * tiles_across(split) < pool.size()) split++;
+    int across = tiles_across(split);
+    std::vector<tile_counts> tops((std::size_t)across * across);
+    std::atomic<int> next{0};
+    pool.run([&](int) {
+        for (int t = next++; t < across * across; t = next++) {
+            tops[t] = count_tile(*this, split, t % across, t / across, sink);
+        }
+    });
+    for (int level = split - 1; level >= 0; level--) {
+        int above = tiles_across(level);
+        std::vector<tile_counts> merged;
+        for (int t = 0; t < above * above; t++) {
+            merged.push_back(empty_tile(*this, level, t % above, t / above));
+        }
+        int below = tiles_across(level + 1);
+        for (int t = 0; t < below * below; t++) {
+            int cx = t % below, cy = t / below;
+            add_child(merged[cy / 2 * above + cx / 2], tops[t], cx % 2, cy % 2,
+                      tile_size, colors.size);
+        }
+        for (int t = 0; t < above * above; t++) sink(level, t % above, t / above, merged[t]);
+        tops.swap(merged);
+    }
+    std::cout << written << " tiles in " << levels << " levels to " << base <<
+                 ".dzi" << std::endl;
+    return ok;
+}
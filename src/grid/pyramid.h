@@ -0,0 +1,42 @@
+#ifndef PYRAMID_H
+#define PYRAMID_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "pool.h"
+#include "render.h"
+
+// Deep zoom pyramid of a pile's full plane, for browsing piles whose
+// picture would be far too large to make in one piece.  Level levels - 1
+// is the 2 width - 1 pixel square image, every level above it half as
+// wide, rounded up, down to a single pixel at level 0, and every level is
+// cut into tile_size square tiles.  A tile is made from the four below it,
+// each pixel keeping how many pixels of the full image under it have each
+// height, so the mode and the mean of the heights are exact at every
+// level.  Only the tiles on one path down to the full image are held at a
+// time, and the full image tiles read their cells straight out of the
+// octant.
+struct tile_pyramid {
+    int width;                  // of the octant
+    int side;                   // of the full image
+    int levels;
+    int tile_size;
+    bool mode;                  // the most common height, else the mean
+    palette colors;             // by height, taller cells get the last one
+    span_source spans;
+
+    tile_pyramid(int width, const span_source &spans, bool mode,
+                 int tile_size = 256, const palette &colors = default_palette());
+    int level_side(int level) const;
+    int tiles_across(int level) const;
+    // the palette tiles are drawn in: colors by mode, or by mean height in
+    // steps blending each color into the next
+    palette tile_palette() const;
+    // palette indices of tile (x, y) of level, row by row
+    std::vector<unsigned char> tile(int level, int x, int y) const;
+    // base.dzi and base_files/level/x_y.png, the tiles spread over the pool
+    bool write(const std::string &base, ThreadPool &pool) const;
+};
+
+#endif
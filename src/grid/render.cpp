@@ -0,0 +1,339 @@
+#include "render.h"
+#include "profile.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+
+// rows per strip handed to the encoders
+static const int strip_rows = 64;
+
+palette default_palette() {
+    palette p;
+    std::fill(p.colors, p.colors + 256, 0xff000000u);
+    p.colors[0] = 0xffffffffu;
+    p.colors[1] = 0xff0096e6u;
+    p.colors[2] = 0xfffac800u;
+    p.colors[3] = 0xffb22864u;
+    p.size = 5;
+    return p;
+}
+
+row_source octant_rows(const octant &nodes) {
+    octant_view grid = nodes.view();
+    return [grid](int ay, unsigned char *row) {
+        // (ax, ay) folds to (i, j) = (ay - ax, ax) above the diagonal and
+        // to (ax - ay, ay) below it
+        for (int ax = 0; ax <= ay; ax++) {
+            row[ax] = std::min<cell_t>(grid(ay - ax, ax), 255);
+        }
+        for (int ax = ay + 1; ax < grid.width; ax++) {
+            row[ax] = std::min<cell_t>(grid(ax - ay, ay), 255);
+        }
+    };
+}
+
+span_source octant_spans(const octant &nodes) {
+    octant_view grid = nodes.view();
+    return [grid](int ay, int ax0, int n, unsigned char *span) {
+        for (int ax = ax0; ax < ax0 + n; ax++) {
+            cell_t height = ax <= ay ? grid(ay - ax, ax) : grid(ax - ay, ay);
+            span[ax - ax0] = std::min<cell_t>(height, 255);
+        }
+    };
+}
+
+// Draws image rows r0 <= r < r1 across the pool and hands each one to
+// emit as palette indices, emit(r, row) being called for distinct r at
+// the same time.
+static void draw_rows(int width, const row_source &rows, ThreadPool &pool,
+                      const palette &colors, int r0, int r1,
+                      const std::function<void(int, const unsigned char*)> &emit) {
+    int side = 2 * width - 1;
+    pool.run([&](int b) {
+        std::vector<unsigned char> half(width), full(side);
+        for (int r = r0 + b; r < r1; r += pool.size()) {
+            rows(std::abs(r - (width - 1)), half.data());
+            for (int c = 0; c < side; c++) {
+                full[c] = std::min<int>(half[std::abs(c - (width - 1))],
+                                        colors.size - 1);
+            }
+            emit(r, full.data());
+        }
+    });
+}
+
+std::vector<std::uint32_t> render_image(int width, const row_source &rows,
+                                        ThreadPool &pool, const palette &colors) {
+    int side = 2 * width - 1;
+    std::vector<std::uint32_t> pixels((std::size_t)side * side);
+    draw_rows(width, rows, pool, colors, 0, side,
+              [&](int r, const unsigned char *row) {
+        std::uint32_t *out = pixels.data() + (std::size_t)r * side;
+        for (int c = 0; c < side; c++) out[c] = colors.colors[row[c]];
+    });
+    return pixels;
+}
+
+static void put16(std::vector<unsigned char> &out, std::uint32_t value) {
+    out.push_back(value & 0xff);
+    out.push_back(value >> 8 & 0xff);
+}
+
+static void put32(std::vector<unsigned char> &out, std::uint32_t value) {
+    put16(out, value & 0xffff);
+    put16(out, value >> 16);
+}
+
+static void put32_be(std::vector<unsigned char> &out, std::uint32_t value) {
+    for (int shift = 24; shift >= 0; shift -= 8) out.push_back(value >> shift & 0xff);
+}
+
+bool write_bmp(const std::string &path, int width, const row_source &rows,
+               ThreadPool &pool, const palette &colors) {
+    int side = 2 * width - 1;
+    std::uint64_t bytes = (std::uint64_t)side * side * 4;
+    if (bytes + 54 > 0xffffffffull) {
+        std::cout << path << ": too large for a BMP, use PNG" << std::endl;
+        return false;
+    }
+    std::ofstream out(path, std::ios::binary);
+    std::vector<unsigned char> header;
+    header.push_back('B');
+    header.push_back('M');
+    put32(header, 54 + bytes);
+    put32(header, 0);
+    put32(header, 54);
+    put32(header, 40);
+    put32(header, side);
+    put32(header, -side);       // negative height: rows run top down
+    put16(header, 1);
+    put16(header, 32);
+    put32(header, 0);           // BI_RGB
+    put32(header, bytes);
+    put32(header, 2835);        // 72 dpi
+    put32(header, 2835);
+    put32(header, 0);
+    put32(header, 0);
+    out.write((const char*)header.data(), header.size());
+
+    // 0xAARRGGBB stored little endian is exactly BMP's B, G, R, A
+    std::vector<std::uint32_t> strip((std::size_t)strip_rows * side);
+    for (int r0 = 0; r0 < side; r0 += strip_rows) {
+        int r1 = std::min(r0 + strip_rows, side);
+        draw_rows(width, rows, pool, colors, r0, r1,
+                  [&](int r, const unsigned char *row) {
+            std::uint32_t *pixels = strip.data() + (std::size_t)(r - r0) * side;
+            for (int c = 0; c < side; c++) pixels[c] = colors.colors[row[c]];
+        });
+        out.write((const char*)strip.data(),
+                  (std::size_t)(r1 - r0) * side * sizeof(std::uint32_t));
+    }
+    out.close();
+    if (not out) std::cout << "writing " << path << " failed" << std::endl;
+    return bool(out);
+}
+
+static std::uint32_t crc32(std::uint32_t crc, const unsigned char *data,
+                           std::size_t n) {
+    static const std::vector<std::uint32_t> table = [] {
+        std::vector<std::uint32_t> t(256);
+        for (std::uint32_t k = 0; k < 256; k++) {
+            std::uint32_t c = k;
+            for (int bit = 0; bit < 8; bit++) {
+                c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            }
+            t[k] = c;
+        }
+        return t;
+    }();
+    crc = ~crc;
+    for (std::size_t k = 0; k < n; k++) {
+        crc = table[(crc ^ data[k]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+static void adler32(std::uint32_t &a, std::uint32_t &b, const unsigned char *data,
+                    std::size_t n) {
+    // 5552 bytes is the most that can be summed before b overflows
+    while (n > 0) {
+        std::size_t run = std::min<std::size_t>(n, 5552);
+        for (std::size_t k = 0; k < run; k++) {
+            a += data[k];
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+        data += run;
+        n -= run;
+    }
+}
+
+static void write_chunk(std::ofstream &out, const char *type,
+                        const std::vector<unsigned char> &data) {
+    std::vector<unsigned char> head;
+    put32_be(head, data.size());
+    head.insert(head.end(), type, type + 4);
+    std::uint32_t crc = crc32(0, head.data() + 4, 4);
+    crc = crc32(crc, data.data(), data.size());
+    std::vector<unsigned char> tail;
+    put32_be(tail, crc);
+    out.write((const char*)head.data(), head.size());
+    out.write((const char*)data.data(), data.size());
+    out.write((const char*)tail.data(), tail.size());
+}
+
+namespace {
+
+// An indexed PNG written a strip of rows at a time: one IDAT per strip
+// holding stored deflate blocks, so no zlib is needed.
+struct png_stream {
+    std::ofstream out;
+    int columns;
+    int depth;
+    std::size_t row_bytes;
+    std::uint32_t a = 1, b = 0;
+    bool first = true;
+
+    png_stream(const std::string &path, int columns, int rows, const palette &colors) :
+        out(path, std::ios::binary),
+        columns(columns),
+        depth(colors.size <= 2 ? 1 : colors.size <= 4 ? 2 : colors.size <= 16 ? 4 : 8),
+        row_bytes(1 + ((std::size_t)columns * depth + 7) / 8) {
+        out.write("\x89PNG\r\n\x1a\n", 8);
+        std::vector<unsigned char> chunk;
+        put32_be(chunk, columns);
+        put32_be(chunk, rows);
+        chunk.push_back(depth);
+        chunk.push_back(3);         // indexed color
+        chunk.push_back(0);
+        chunk.push_back(0);
+        chunk.push_back(0);
+        write_chunk(out, "IHDR", chunk);
+        chunk.clear();
+        for (int k = 0; k < colors.size; k++) {
+            chunk.push_back(colors.colors[k] >> 16 & 0xff);
+            chunk.push_back(colors.colors[k] >> 8 & 0xff);
+            chunk.push_back(colors.colors[k] & 0xff);
+        }
+        write_chunk(out, "PLTE", chunk);
+    }
+
+    // packs palette index c of row into a filtered PNG row
+    void pack(unsigned char *packed, const unsigned char *row) const {
+        std::fill(packed, packed + row_bytes, 0);   // filter type none
+        for (int c = 0; c < columns; c++) {
+            std::size_t bit = (std::size_t)c * depth;
+            packed[1 + bit / 8] |= row[c] << (8 - depth - bit % 8);
+        }
+    }
+
+    // n bytes of packed rows
+    void write(const unsigned char *data, std::size_t n) {
+        adler32(a, b, data, n);
+        std::vector<unsigned char> chunk;
+        if (first) {
+            chunk.push_back(0x78);
+            chunk.push_back(0x01);
+            first = false;
+        }
+        for (std::size_t k = 0; k < n; k += 65535) {
+            std::size_t len = std::min<std::size_t>(n - k, 65535);
+            chunk.push_back(0);     // not final, stored
+            put16(chunk, len);
+            put16(chunk, ~len & 0xffff);
+            chunk.insert(chunk.end(), data + k, data + k + len);
+        }
+        write_chunk(out, "IDAT", chunk);
+    }
+
+    bool finish(const std::string &path) {
+        // an empty final block closes the deflate stream
+        std::vector<unsigned char> chunk = {1, 0, 0, 0xff, 0xff};
+        if (first) chunk.insert(chunk.begin(), {0x78, 0x01});
+        put32_be(chunk, b << 16 | a);
+        write_chunk(out, "IDAT", chunk);
+        write_chunk(out, "IEND", {});
+        out.close();
+        if (not out) std::cout << "writing " << path << " failed" << std::endl;
+        return bool(out);
+    }
+};
+
+}
+
+bool write_png(const std::string &path, int width, const row_source &rows,
+               ThreadPool &pool, const palette &colors) {
+    int side = 2 * width - 1;
+    png_stream png(path, side, side, colors);
+    std::vector<unsigned char> strip(strip_rows * png.row_bytes);
+    for (int r0 = 0; r0 < side; r0 += strip_rows) {
+        int r1 = std::min(r0 + strip_rows, side);
+        draw_rows(width, rows, pool, colors, r0, r1,
+                  [&](int r, const unsigned char *row) {
+            png.pack(strip.data() + (r - r0) * png.row_bytes, row);
+        });
+        png.write(strip.data(), (r1 - r0) * png.row_bytes);
+    }
+    return png.finish(path);
+}
+
+bool write_indexed_png(const std::string &path, int columns, int rows,
+                       const unsigned char *indices, const palette &colors) {
+    png_stream png(path, columns, rows, colors);
+    std::vector<unsigned char> packed(rows * png.row_bytes);
+    for (int r = 0; r < rows; r++) {
+        png.pack(packed.data() + r * png.row_bytes, indices + (std::size_t)r * columns);
+    }
+    png.write(packed.data(), packed.size());
+    return png.finish(path);
+}
+
+void write_y4m_header(std::ostream &out, int width, int fps) {
+    int side = 2 * width - 1;
+    out << "YUV4MPEG2 W" << side << " H" << side << " F" << fps <<
+           ":1 Ip A1:1 C444 XCOLORRANGE=FULL\n";
+}
+
+// one plane after the other, so every strip is drawn three times; drawing
+// is cheap next to the bytes written
+bool write_y4m_frame(std::ostream &out, int width, const row_source &rows,
+                     ThreadPool &pool, const palette &colors) {
+    int side = 2 * width - 1;
+    unsigned char yuv[3][256];
+    for (int k = 0; k < 256; k++) {
+        double r = colors.colors[k] >> 16 & 0xff;
+        double g = colors.colors[k] >> 8 & 0xff;
+        double b = colors.colors[k] & 0xff;
+        double y = 0.299 * r + 0.587 * g + 0.114 * b;
+        yuv[0][k] = std::lround(y);
+        yuv[1][k] = std::lround(std::min(255.0, 128 + (b - y) * 0.564));
+        yuv[2][k] = std::lround(std::min(255.0, 128 + (r - y) * 0.713));
+    }
+    out << "FRAME\n";
+    std::vector<unsigned char> strip((std::size_t)strip_rows * side);
+    for (int plane = 0; plane < 3; plane++) {
+        for (int r0 = 0; r0 < side; r0 += strip_rows) {
+            int r1 = std::min(r0 + strip_rows, side);
+            draw_rows(width, rows, pool, colors, r0, r1,
+                      [&](int r, const unsigned char *row) {
+                unsigned char *pixels = strip.data() + (std::size_t)(r - r0) * side;
+                for (int c = 0; c < side; c++) pixels[c] = yuv[plane][row[c]];
+            });
+            out.write((const char*)strip.data(), (std::size_t)(r1 - r0) * side);
+        }
+    }
+    return bool(out);
+}
+
+bool write_image(const std::string &path, int width, const row_source &rows,
+                 ThreadPool &pool, const palette &colors) {
+    PROFILE_SCOPE("paint");
+    std::string ext = path.substr(path.find_last_of('.') + 1);
+    if (ext == "bmp") return write_bmp(path, width, rows, pool, colors);
+    if (ext == "png") return write_png(path, width, rows, pool, colors);
+    std::cout << path << ": unknown image type, use .bmp or .png" << std::endl;
+    return false;
+}
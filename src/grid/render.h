@@ -0,0 +1,64 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "octant.h"
+#include "pool.h"
+
+// Offscreen rendering of a pile to the full plane, 2 width - 1 pixels
+// square with the origin in the middle.  Images are made a strip of rows
+// at a time, the rows of a strip spread over the pool, and each strip goes
+// to the encoder before the next one is drawn, so memory stays bounded no
+// matter how large the picture.
+
+struct palette {
+    std::uint32_t colors[256];  // 0xAARRGGBB by height
+    int size;                   // colors in use, taller cells get the last one
+};
+
+// white, blue, yellow and purple for 0 to 3, black for anything taller
+palette default_palette();
+
+// Fills row[ax] with the height at plane point (ax, ay) for 0 <= ax < width,
+// clamped to 255.  Only one quadrant is asked for, the rest is mirrored.
+typedef std::function<void(int ay, unsigned char *row)> row_source;
+
+row_source octant_rows(const octant &nodes);
+
+// Fills span[k] with the height at (ax0 + k, ay) for 0 <= k < n, clamped
+// to 255, for tiles that only need part of a row.
+typedef std::function<void(int ay, int ax0, int n, unsigned char *span)> span_source;
+
+span_source octant_spans(const octant &nodes);
+
+// picks BMP or PNG by the extension of path
+bool write_image(const std::string &path, int width, const row_source &rows,
+                 ThreadPool &pool, const palette &colors = default_palette());
+// 32 bit top-down BMP straight from the palette
+bool write_bmp(const std::string &path, int width, const row_source &rows,
+               ThreadPool &pool, const palette &colors = default_palette());
+// indexed PNG at the smallest bit depth the palette fits in, stored deflate
+// blocks so no zlib is needed
+bool write_png(const std::string &path, int width, const row_source &rows,
+               ThreadPool &pool, const palette &colors = default_palette());
+
+// a columns by rows picture of palette indices as an indexed PNG, for tiles
+bool write_indexed_png(const std::string &path, int columns, int rows,
+                       const unsigned char *indices, const palette &colors);
+
+// YUV4MPEG2 for video tools: the header once, then one frame at a time,
+// full range 4:4:4 converted from the palette
+void write_y4m_header(std::ostream &out, int width, int fps = 25);
+bool write_y4m_frame(std::ostream &out, int width, const row_source &rows,
+                     ThreadPool &pool, const palette &colors = default_palette());
+
+// the whole image in memory as 0xAARRGGBB, for viewers
+std::vector<std::uint32_t> render_image(int width, const row_source &rows,
+                                        ThreadPool &pool,
+                                        const palette &colors = default_palette());
+
+#endif
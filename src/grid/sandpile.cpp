@@ -1,24 +1,54 @@
 //#include <emscripten.h>
+#ifdef USE_SDL
 #include <SDL2/SDL.h>
+#endif
 #include "pile.h"
+#include "options.h"
+#include "warmstart.h"
+#include "snapshot.h"
+#include "pyramid.h"
+#include "render.h"
+#include "compact.h"
+#include "driven.h"
+#include "frames.h"
+#include "sweep.h"
+#include "profile.h"
 
 #include <iostream>
 #include <fstream>
 #include <chrono>
+#include <cmath>
+#include <memory>
 #include <string>
 
 void printPile(pile &sandpile, std::string filename) {
+    PROFILE_SCOPE("print");
     std::ofstream outfile;
+    octant_view grid = sandpile.nodes.view();
     outfile.open(filename);
-    for (int i = 0; i < sandpile.nodes.size(); i++) {
-        for (int j = 0; j < sandpile.nodes[i].size(); j++) {
-           outfile << " " << sandpile.nodes[i][j];
+    for (int i = 0; i < grid.width; i++) {
+        for (int j = 0; j < grid.length(i); j++) {
+           outfile << " " << grid(i, j);
         }
         outfile << std::endl;
     }
     outfile.close();
 }
 
+void printOdometer(pile &sandpile, std::string filename) {
+    std::ofstream outfile;
+    outfile.open(filename);
+    for (int i = 0; i < sandpile.nodes.width; i++) {
+        std::uint64_t *odometer = sandpile.odometer_column(i);
+        for (int j = 0; j < sandpile.nodes.length(i); j++) {
+           outfile << " " << odometer[j];
+        }
+        outfile << std::endl;
+    }
+    outfile.close();
+}
+
+#ifdef USE_SDL
 static void sdlError(const char *str)
 {
     std::cout <<  "Error at " << str << ": " << SDL_GetError() << std::endl;
@@ -26,101 +56,208 @@ static void sdlError(const char *str)
     //  emscripten_force_exit(1);
 }
 
-void draw(pile &sandpile, int N, std::string filename) {
+// shows the rendered pile until the window is closed
+void view(std::vector<std::uint32_t> &pixels, int side) {
 
     SDL_Window *window;
     SDL_Surface *surface;
+    SDL_Surface *image;
 
     if (SDL_Init(SDL_INIT_VIDEO) != 0) sdlError("SDL_Init");
 
     window = SDL_CreateWindow("Sand Piles",
                               SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
-                              2 * N - 1, 2 * N - 1,
+                              side, side,
                               SDL_WINDOW_SHOWN);
     if (window == NULL) sdlError("SDL_CreateWindow");
     surface = SDL_GetWindowSurface(window);
     if (surface == NULL) sdlError("SDL_GetWindowSurface");
+    image = SDL_CreateRGBSurfaceWithFormatFrom(pixels.data(), side, side, 32,
+                                               side * sizeof(std::uint32_t),
+                                               SDL_PIXELFORMAT_ARGB8888);
+    if (image == NULL) sdlError("SDL_CreateRGBSurfaceWithFormatFrom");
 
-    int x, y, z, i, j;
-
-    if (SDL_MUSTLOCK(surface)) {
-        if (SDL_LockSurface(surface) != 0) sdlError("SDL_LockSurface");
-    }
-
-    for (y = -N + 1; y < N; y++) {
-        Uint32 *p = (Uint32 *)(((Uint8 *)surface->pixels) +
-                               surface->pitch * (y+N-1));
-        for (x = -N + 1; x < N; x++) {
-            if (abs(x) <= abs(y)) {
-                i = abs(y) - abs(x);
-                j = abs(x);
-            } else {
-                i = abs(x) - abs(y);
-                j = abs(y);
-            }
-            if ((i >= sandpile.nodes.size()) | (j >= sandpile.nodes[i].size()))
-            {
-                z = 0;
-            } else {
-                z = sandpile.nodes[i][j];
-            }
-
-            switch(z) {
-                case 0:
-                    *(p++) = SDL_MapRGB(surface->format, 255, 255, 255);
-                    break;
-                case 1:
-                    *(p++) = SDL_MapRGB(surface->format, 0, 150, 230);
-                    break;
-                case 2:
-                    *(p++) = SDL_MapRGB(surface->format, 250, 200, 0);
-                    break;
-                case 3:
-                    *(p++) = SDL_MapRGB(surface->format, 178, 40, 100);
-                    break;
-                default:
-                    std::cout << "missed values " << z << " at x: " << x << 
-                                 " and y: " << y << std::endl;
-            }
-        }
-    }
-
-    if (SDL_MUSTLOCK(surface)) SDL_UnlockSurface(surface);
+    if (SDL_BlitSurface(image, NULL, surface, NULL) != 0) sdlError("SDL_BlitSurface");
     if (SDL_UpdateWindowSurface(window) != 0)
         sdlError("SDL_UpdateWindowSurface");
 
+    SDL_Event event;
+    while (SDL_WaitEvent(&event) and event.type != SDL_QUIT) { }
 
-    SDL_SaveBMP(surface, filename.c_str());
-    //Wait two seconds
-    SDL_Delay( 2000 );
-
+    SDL_FreeSurface(image);
     //Destroy window
     SDL_DestroyWindow( window );
     //Quit SDL subsystems
     SDL_Quit();
 }
+#endif
+
+
+// The compact engine never holds a full size octant, so it gets its own
+// short path: no odometer, checkpoints, warm start or drops, just the picture.
+int runCompact(const options &opts, int width, std::string filename) {
+    using namespace std::chrono;
+    if (not opts.resume.empty()) {
+        std::cout << "the compact engine does not resume" << std::endl;
+        return 1;
+    }
+    if (opts.grains > 0xffffffffull) {
+        std::cout << "the compact engine holds at most 2^32 - 1 grains" << std::endl;
+        return 1;
+    }
+    compact_pile sandpile(width);
+    sandpile.cells.set(0, 0, opts.grains);
+    sandpile.kernel = kernel_by_name(opts.kernel);
+    if (sandpile.kernel == nullptr) {
+        std::cout << "kernel " << opts.kernel << " not available" << std::endl;
+        return 1;
+    }
+    std::cout << opts.grains << " grains of sand, compact engine, " <<
+                 kernel_name(sandpile.kernel) << " kernel" << std::endl;
 
+    high_resolution_clock::time_point t1 = high_resolution_clock::now();
+    {
+        PROFILE_SCOPE("stabilize");
+        sandpile.stabilize();
+    }
+    high_resolution_clock::time_point t2 = high_resolution_clock::now();
+    duration<double> time_span = duration_cast<duration<double>>(t2 - t1);
+    std::cout << "stabilization done.  Time elapsed: " << time_span.count() << std::endl;
+    std::cout << "size: " << sandpile.cells.width << " wide, " <<
+                 sandpile.cells.bytes() << " bytes" << std::endl;
 
-int main(void) {
+    if (opts.image != "none") {
+        ThreadPool painters(opts.threads);
+        write_image(filename + "." + opts.image, sandpile.cells.width,
+                    compact_rows(sandpile.cells), painters);
+    }
+    if (not opts.pyramid.empty()) {
+        ThreadPool tilers(opts.threads);
+        tile_pyramid pyramid(sandpile.cells.width, compact_spans(sandpile.cells),
+                             opts.pyramid_downsample == "mode");
+        pyramid.write(opts.pyramid, tilers);
+    }
+    if (not opts.profile.empty()) write_profile(opts.profile);
+    return 0;
+}
+
+// A sweep over grain counts: every pile is carried from one count to the
+// next, and every stable pile is written as if it had been its own run.
+// With several jobs each sweep gets one thread of the pool and a pile of
+// its own.
+int runSweep(const options &opts, int width, int max_width) {
+    using namespace std::chrono;
+    if (opts.engine == "compact") {
+        std::cout << "the compact engine does not sweep" << std::endl;
+        return 1;
+    }
+    if (kernel_by_name(opts.kernel) == nullptr) {
+        std::cout << "kernel " << opts.kernel << " not available" << std::endl;
+        return 1;
+    }
+    std::vector<std::uint64_t> counts(opts.sweep.begin(), opts.sweep.end());
+    std::vector<std::vector<std::uint64_t>> sweeps = split_sweeps(counts, opts.sweep_jobs);
+    bool alone = sweeps.size() == 1;
+    std::cout << counts.size() << " grain counts in " << sweeps.size() <<
+                 " sweeps, " << width << " wide" << std::endl;
+    high_resolution_clock::time_point t0 = high_resolution_clock::now();
+    std::mutex print;
+    ThreadPool pool(alone ? opts.threads : sweeps.size());
+    auto stabilize = [&](pile &sandpile) {
+        if (not alone) sandpile.stabilize(1);
+        else if (opts.engine == "bands") sandpile.stabilize_bands(pool);
+        else if (opts.engine == "tiles") sandpile.stabilize_tiles(pool);
+        else if (opts.engine == "processes") sandpile.stabilize_processes(opts.threads);
+        else sandpile.stabilize(opts.threads);
+    };
+    auto run = [&](int job) {
+        if (job >= (int)sweeps.size()) return;
+        pile sandpile(width, max_width);
+        sandpile.kernel = kernel_by_name(opts.kernel);
+        sandpile.sliced_tail = opts.sliced_tail;
+        high_resolution_clock::time_point t1 = high_resolution_clock::now();
+        sweep_grains(sandpile, sweeps[job], stabilize,
+                     [&](pile &stable, std::uint64_t grains) {
+            high_resolution_clock::time_point t2 = high_resolution_clock::now();
+            std::string name = "out/" + std::to_string(stable.nodes.width) + "-" +
+                               std::to_string(grains);
+            write_snapshot(take_snapshot(stable), name + ".snap");
+            if (opts.image != "none") {
+                ThreadPool painters(alone ? opts.threads : 1);
+                write_image(name + "." + opts.image, stable.nodes.width,
+                            octant_rows(stable.nodes), painters);
+            }
+            std::lock_guard<std::mutex> lock(print);
+            std::cout << grains << " grains stable after " <<
+                         duration<double>(t2 - t1).count() << " s, written to " <<
+                         name << std::endl;
+            t1 = high_resolution_clock::now();
+        });
+    };
+    if (alone) run(0);
+    else pool.run(run);
+    std::cout << "sweep done.  Time elapsed: " <<
+                 duration<double>(high_resolution_clock::now() - t0).count() << std::endl;
+    if (not opts.profile.empty()) write_profile(opts.profile);
+    return 0;
+}
+
+// The width a pile of grains starting width wide may grow to: none past
+// width unless --max-width asks, auto leaving a quarter past the sized one.
+// A resumed pile passes the width and grains of its snapshot.
+int max_width_for(const options &opts, int width, std::uint64_t grains) {
+    if (opts.max_width < 0) return width;
+    return opts.max_width != 0 ? opts.max_width : width_for_grains(grains) * 5 / 4;
+}
+
+int main(int argc, char **argv) {
 
     using namespace std::chrono;
 
+    options opts;
+    if (not parse_options(argc, argv, opts)) return 1;
+    if (not opts.profile.empty() and not profile_start()) return 1;
 
-    int width = 600;
-    unsigned int numGrains = pow(2,21);
-    //int width = 10;
-    //unsigned int numGrains = pow(2,7);
+    // a sweep is sized for its largest count
+    if (not opts.sweep.empty()) opts.grains = opts.sweep.back();
+    int width = opts.width != 0 ? opts.width : width_for_grains(opts.grains);
+    if (not opts.sweep.empty()) {
+        return runSweep(opts, width, max_width_for(opts, width, opts.grains));
+    }
+    std::uint64_t numGrains = opts.grains;
+    snapshot_header header;
+    if (not opts.resume.empty()) {
+        if (not read_snapshot_header(opts.resume, header)) return 1;
+        width = header.width;
+        numGrains = header.grains;
+    }
+    int max_width = max_width_for(opts, width, numGrains);
     
     std::string filename = "out/" +
                            std::to_string(width) + "-" +
                            std::to_string(numGrains);
 
     std::cout << "using base filename " << filename << std::endl;
+    if (opts.engine == "compact") return runCompact(opts, width, filename);
     
     high_resolution_clock::time_point t1 = high_resolution_clock::now();
 
-    pile sandpile(width);
-    sandpile.nodes[0][0] = numGrains;
+    pile sandpile(width, max_width);
+    if (opts.resume.empty()) {
+        sandpile.add_grains(numGrains);
+    } else if (load_snapshot(opts.resume, sandpile)) {
+        std::cout << "resuming " << opts.resume << " after " <<
+                     sandpile.sweeps << " sweeps" << std::endl;
+    } else {
+        return 1;
+    }
+    sandpile.kernel = kernel_by_name(opts.kernel);
+    sandpile.sliced_tail = opts.sliced_tail;
+    if (sandpile.kernel == nullptr) {
+        std::cout << "kernel " << opts.kernel << " not available" << std::endl;
+        return 1;
+    }
+    if (not opts.odometer.empty()) sandpile.enable_odometer();
 
     high_resolution_clock::time_point t2 = high_resolution_clock::now();
     duration<double> time_span = duration_cast<duration<double>>(t2 - t1);
@@ -128,30 +265,141 @@ int main(void) {
     std::cout << "initialization done.  Time elapsed: " << time_span.count() << std::endl;
 
 
-    std::cout << sandpile.nodes[0][0] << " grains of sand" << std::endl;
+    std::unique_ptr<SnapshotWriter> checkpoint;
+    if (not opts.checkpoint.empty()) {
+        checkpoint.reset(new SnapshotWriter(opts.checkpoint));
+        sandpile.checkpoint = checkpoint.get();
+        sandpile.checkpoint_interval = opts.checkpoint_interval;
+    }
+
+    if (opts.warm_start > 0 and opts.resume.empty()) {
+        t1 = high_resolution_clock::now();
+        warm_start_stats stats = warm_start(sandpile, opts.warm_start);
+        t2 = high_resolution_clock::now();
+        time_span = duration_cast<duration<double>>(t2 - t1);
+        std::cout << "warm start done: " << stats.solver_iterations <<
+                     " solver iterations, " << stats.repair_rounds <<
+                     " repair rounds, " << stats.topples <<
+                     " topplings skipped.  Time elapsed: " <<
+                     time_span.count() << std::endl;
+    }
+
+    std::cout << numGrains << " grains of sand, " <<
+                 opts.threads << " threads, " << opts.engine << " engine, " <<
+                 kernel_name(sandpile.kernel) << " kernel" << std::endl;
     t1 = high_resolution_clock::now();
 
-    sandpile.stabilize();
+    std::unique_ptr<StatsWriter> stats;
+    if (not opts.stats.empty()) {
+        stats.reset(new StatsWriter(sandpile.telemetry, opts.stats,
+                                    opts.stats_interval));
+    }
+    // frames are encoded on a thread of their own, the stabilizers only copy
+    std::unique_ptr<FrameWriter> frames;
+    if (not opts.frames.empty()) {
+        frames.reset(new FrameWriter(opts.frames, sandpile.nodes.capacity));
+        if (not frames->good()) return 1;
+        if (opts.engine == "tiles" or opts.engine == "processes") {
+            std::cout << "the " << opts.engine <<
+                         " engine takes no frames, only the last one" << std::endl;
+        }
+        sandpile.frames = frames.get();
+        sandpile.frame_interval = opts.frame_interval;
+        sandpile.frame_topples = opts.frame_topples;
+    }
+    if (opts.engine == "bands") {
+        ThreadPool pool(opts.threads);
+        PROFILE_SCOPE("stabilize");
+        sandpile.stabilize_bands(pool);
+    } else if (opts.engine == "tiles") {
+        ThreadPool pool(opts.threads);
+        PROFILE_SCOPE("stabilize");
+        sandpile.stabilize_tiles(pool);
+    } else if (opts.engine == "processes") {
+        if (checkpoint) {
+            std::cout << "the processes engine takes no checkpoints" << std::endl;
+        }
+        PROFILE_SCOPE("stabilize");
+        if (sandpile.stabilize_processes(opts.threads) < 0) return 1;
+    } else {
+        PROFILE_SCOPE("stabilize");
+        sandpile.stabilize(opts.threads);
+    }
+    stats.reset();
 
     t2 = high_resolution_clock::now();
     time_span = duration_cast<duration<double>>(t2 - t1);
     std::cout << "stabilization done.  Time elapsed: " << time_span.count() << std::endl;
-    std::cout << "size: " << sandpile.nodes.size() << " x " <<
-                  sandpile.nodes[0].size() << std::endl;
+    std::cout << "size: " << sandpile.nodes.width << " wide, " <<
+                  sandpile.nodes.size() << " cells" << std::endl;
+    if (frames) {
+        // the stable pile is the last frame
+        frames->submit(take_snapshot(sandpile, false));
+        frames->wait();
+        std::cout << frames->written() << " frames written to " <<
+                     opts.frames << std::endl;
+        sandpile.frames = nullptr;
+    }
+
+    if (opts.drops > 0) {
+        t1 = high_resolution_clock::now();
+        driven_pile driven(sandpile);
+        std::mt19937_64 rng(opts.seed);
+        avalanche_stats stats;
+        driven.drive(opts.drops, opts.drop_site == "random", rng, stats);
+        t2 = high_resolution_clock::now();
+        time_span = duration_cast<duration<double>>(t2 - t1);
+        std::cout << stats.drops << " drops, " << stats.topples <<
+                     " topples, " << stats.lost << " grains lost.  Time elapsed: " <<
+                     time_span.count() << " (" <<
+                     stats.drops / time_span.count() << " drops/s)" << std::endl;
+        write_histograms(opts.avalanches.empty() ?
+                         filename + "-avalanches.txt" : opts.avalanches, stats);
+    }
 
+    // the final snapshot is written in the background while we draw
+    SnapshotWriter output(filename + ".snap");
     t1 = high_resolution_clock::now();
-    printPile(sandpile, filename + ".txt");
+    if (opts.format == "text") {
+        printPile(sandpile, filename + ".txt");
+    } else {
+        output.submit(take_snapshot(sandpile));
+    }
     t2 = high_resolution_clock::now();
     time_span = duration_cast<duration<double>>(t2 - t1);
 
     std::cout << "printing done.  Time elapsed: " << time_span.count() << std::endl;
 
+    if (not opts.odometer.empty()) {
+        printOdometer(sandpile, opts.odometer);
+    }
+
     t1 = high_resolution_clock::now();
 
-    draw(sandpile, sandpile.nodes.size(), filename + ".bmp");
+    ThreadPool painters(opts.threads);
+    if (opts.image != "none") {
+        write_image(filename + "." + opts.image, sandpile.nodes.width,
+                    octant_rows(sandpile.nodes), painters);
+    }
+    if (not opts.pyramid.empty()) {
+        tile_pyramid pyramid(sandpile.nodes.width, octant_spans(sandpile.nodes),
+                             opts.pyramid_downsample == "mode");
+        pyramid.write(opts.pyramid, painters);
+    }
 
     t2 = high_resolution_clock::now();
     time_span = duration_cast<duration<double>>(t2 - t1);
 
     std::cout << "painting done.  Time elapsed: " << time_span.count() << std::endl;
+
+    if (opts.view) {
+#ifdef USE_SDL
+        std::vector<std::uint32_t> pixels =
+            render_image(sandpile.nodes.width, octant_rows(sandpile.nodes), painters);
+        view(pixels, 2 * sandpile.nodes.width - 1);
+#else
+        std::cout << "built without SDL, --view needs -DUSE_SDL" << std::endl;
+#endif
+    }
+    if (not opts.profile.empty()) write_profile(opts.profile);
 }
@@ -0,0 +1,298 @@
+#include "sliced.h"
+#include "pile.h"
+#include "fold.h"
+#include "profile.h"
+#include <algorithm>
+#include <iostream>
+
+// Bit sliced stabilizer for the tail of a run.  Once the source has drained
+// and every cell is below 8, a toppling cell sheds one grain a spill, so a
+// column's topplings are just its top plane, and handing them to a
+// neighbour is a ripple carry add of that word into the neighbour's planes.
+// Sweeping the columns in order, as the chain does, keeps nearly every cell
+// below 8; the few that carry out of the top plane go to the overflow list
+// and topple one by one the next time their column comes round.
+
+sliced_octant::sliced_octant(int width) :
+    width(width),
+    offsets(width + 1),
+    overflow(width),
+    sinks(width, 0) {
+    offsets[0] = 0;
+    for (int i = 0; i < width; i++) offsets[i+1] = offsets[i] + planes * words(i);
+    bits.assign(offsets[width], 0);
+}
+
+cell_t sliced_octant::get(int i, int j) const {
+    if (j == length(i) - 1) return sinks[i];
+    const std::uint64_t *column = bits.data() + offsets[i];
+    cell_t height = 0;
+    for (int p = 0; p < planes; p++) {
+        height |= cell_t(column[p * words(i) + j / 64] >> (j % 64) & 1) << p;
+    }
+    for (const std::pair<int, cell_t> &extra : overflow[i]) {
+        if (extra.first == j) height += extra.second;
+    }
+    return height;
+}
+
+void sliced_octant::pack(const octant &nodes) {
+    std::fill(bits.begin(), bits.end(), 0);
+    for (int i = 0; i < width; i++) {
+        const cell_t *column = nodes.column(i);
+        int sink = length(i) - 1;
+        overflow[i].clear();
+        for (int p = 0; p < planes; p++) {
+            std::uint64_t *words = plane(i, p);
+            for (int j = 0; j < sink; j++) {
+                words[j / 64] |= std::uint64_t(column[j] >> p & 1) << (j % 64);
+            }
+        }
+        for (int j = 0; j < sink; j++) {
+            if (column[j] >= below) overflow[i].emplace_back(j, column[j] & ~(below - 1));
+        }
+        sinks[i] = column[sink];
+    }
+}
+
+void sliced_octant::unpack(octant &nodes) const {
+    for (int i = 0; i < width; i++) {
+        cell_t *column = nodes.column(i);
+        for (int j = 0; j < length(i); j++) column[j] = get(i, j);
+    }
+}
+
+namespace {
+
+// The fold weights as masks.  By source column class I (0, 1, or 2 for
+// the rest), spill k and bit q of the weight: the cells of the first word,
+// whose rows 0 and 1 lie on a fold, and of every later word that send
+// their k-th spill that bit of the weight.
+struct spill_masks {
+    std::uint64_t first[3][spills][sliced_octant::planes];
+    std::uint64_t rest[3][spills][sliced_octant::planes];
+    std::uint64_t multiplicity[3][3];
+    spill_masks() {
+        for (int I = 0; I < 3; I++) {
+            for (int k = 0; k < spills; k++) {
+                for (int q = 0; q < sliced_octant::planes; q++) {
+                    std::uint64_t bulk = octant_weights::weight(I, 2, k) >> q & 1;
+                    rest[I][k][q] = bulk ? ~std::uint64_t(0) : 0;
+                    first[I][k][q] = bulk ? ~std::uint64_t(3) : 0;
+                    for (int J = 0; J < 2; J++) {
+                        std::uint64_t edge = octant_weights::weight(I, J, k) >> q & 1;
+                        first[I][k][q] |= edge << J;
+                    }
+                }
+            }
+            for (int J = 0; J < 3; J++) {
+                multiplicity[I][J] = octant_weights::multiplicity(I, J);
+            }
+        }
+    }
+};
+
+const spill_masks masks;
+
+// One sweep over a sliced octant, column by column.
+struct sliced_sweep {
+    sliced_octant &cells;
+    std::vector<int> &j_range;
+    sweep_tally tally;
+
+    // cells that carried out of the top plane hold 8 more than it shows
+    void carry_out(int i, int w, std::uint64_t x) {
+        for (; x != 0; x &= x - 1) {
+            cells.overflow[i].emplace_back(w * 64 + __builtin_ctzll(x), sliced_octant::below);
+        }
+    }
+
+    // adds x, shifted left by q, to word w of column i
+    void add_word(int i, int w, int q, std::uint64_t x) {
+        std::uint64_t *column = cells.plane(i, 0);
+        int words = cells.words(i);
+        for (; q < sliced_octant::planes and x != 0; q++) {
+            std::uint64_t &word = column[q * words + w];
+            std::uint64_t carry = word & x;
+            word ^= x;
+            x = carry;
+        }
+        if (x != 0) carry_out(i, w, x);
+    }
+
+    // adds a + b, two words of single grains, to word w of column i
+    void add_pair(int i, int w, std::uint64_t a, std::uint64_t b) {
+        std::uint64_t *column = cells.plane(i, 0);
+        int words = cells.words(i);
+        std::uint64_t &p0 = column[w];
+        std::uint64_t &p1 = column[words + w];
+        std::uint64_t &p2 = column[2 * words + w];
+        std::uint64_t low = a ^ b, high = a & b;
+        std::uint64_t carry = p0 & low;
+        p0 ^= low;
+        std::uint64_t t = high ^ carry;
+        carry = (high & carry) | (p1 & t);
+        p1 ^= t;
+        if (p2 & carry) carry_out(i, w, p2 & carry);
+        p2 ^= carry;
+    }
+
+    // adds grains to cell (i, j), past the planes straight to the overflow
+    void add_cell(int i, int j, cell_t grains) {
+        if (j == cells.length(i) - 1) {
+            cells.sinks[i] += grains;
+            return;
+        }
+        if (grains >= sliced_octant::below) {
+            cells.overflow[i].emplace_back(j, grains & ~(sliced_octant::below - 1));
+        }
+        for (int q = 0; q < sliced_octant::planes; q++) {
+            if (grains >> q & 1) add_word(i, j / 64, q, std::uint64_t(1) << (j % 64));
+        }
+    }
+
+    // Topples the cells of column i on the overflow list one at a time,
+    // as often as they can, which leaves them below 4 for the word path.
+    bool topple_overflow(int i, std::uint64_t *odometer) {
+        if (cells.overflow[i].empty()) return true;
+        std::vector<std::pair<int, cell_t>> tall;
+        tall.swap(cells.overflow[i]);
+        int I = std::min(i, 2);
+        int edge = cells.length(i) - 2;
+        std::uint64_t *column = cells.plane(i, 0);
+        int words = cells.words(i);
+        for (const std::pair<int, cell_t> &extra : tall) {
+            int j = extra.first;
+            int J = std::min(j, 2);
+            cell_t height = cells.get(i, j) + extra.second;
+            cell_t spillover = height / 4;
+            for (int q = 0; q < sliced_octant::planes; q++) {
+                std::uint64_t &word = column[q * words + j / 64];
+                word &= ~(std::uint64_t(1) << (j % 64));
+                word |= std::uint64_t(height % 4 >> q & 1) << (j % 64);
+            }
+            tally.topples += masks.multiplicity[I][J] * spillover;
+            if (odometer != nullptr) odometer[j] += spillover;
+            j_range[i] = std::max(j_range[i], std::min(j + 1, edge + 1));
+            // spills: left[j], left[j+1], right[j-1], right[j]
+            for (int k = 0; k < spills; k++) {
+                cell_t grains = octant_weights::weight(I, J, k) * spillover;
+                if (grains == 0) continue;
+                if (k == 3 and j == edge) {
+                    tally.lost += (edge == 0 ? 4 : 8) * std::uint64_t(grains);
+                }
+                add_cell(i + spill_di[k], j + spill_dj[k], grains);
+            }
+        }
+        return false;
+    }
+
+    // topples column i once through its neighbours, see topple_column
+    bool topple(int i, std::uint64_t *odometer) {
+        bool done = topple_overflow(i, odometer);
+        int I = std::min(i, 2);
+        int words = cells.words(i);
+        std::uint64_t *top = cells.plane(i, sliced_octant::planes - 1);
+        // the last cell it topples feeds the sink of column i+1
+        int edge = cells.length(i) - 2;
+        for (int w = 0; w < words; w++) {
+            std::uint64_t s = top[w];
+            if (s == 0) continue;
+            done = false;
+            top[w] = 0;
+            tally.topples += masks.multiplicity[I][2] * __builtin_popcountll(s);
+            if (w == 0) {
+                for (int J = 0; J < 2; J++) {
+                    tally.topples += (s >> J & 1) *
+                                     (masks.multiplicity[I][J] - masks.multiplicity[I][2]);
+                }
+            }
+            if (odometer != nullptr) {
+                for (std::uint64_t x = s; x != 0; x &= x - 1) {
+                    odometer[w * 64 + __builtin_ctzll(x)]++;
+                }
+            }
+            j_range[i] = std::max(j_range[i],
+                                  std::min(w * 64 + 64 - __builtin_clzll(s), edge + 1));
+            // what lands on right[j]: all but the edge cell's, which the sink catches
+            std::uint64_t r = s;
+            if (w == edge / 64 and (s >> (edge % 64) & 1)) {
+                r &= ~(std::uint64_t(1) << (edge % 64));
+                cell_t grains = octant_weights::weight(I, std::min(edge, 2), 3);
+                cells.sinks[i+1] += grains;
+                tally.lost += (edge == 0 ? 4 : 8) * std::uint64_t(grains);
+            }
+            if (I == 2 and w > 0) {
+                // the bulk: one grain to each spill
+                add_pair(i-1, w, s, s << 1);
+                if (s >> 63) add_word(i-1, w + 1, 0, 1);
+                add_pair(i+1, w, s >> 1, r);
+                if (s & 1) add_word(i+1, w - 1, 0, std::uint64_t(1) << 63);
+                continue;
+            }
+            const std::uint64_t (*weights)[sliced_octant::planes] =
+                w == 0 ? masks.first[I] : masks.rest[I];
+            for (int q = 0; q < sliced_octant::planes; q++) {
+                std::uint64_t x = s & weights[0][q];
+                if (x != 0) add_word(i-1, w, q, x);
+                x = s & weights[1][q];
+                if (x != 0) {
+                    add_word(i-1, w, q, x << 1);
+                    if (x >> 63) add_word(i-1, w + 1, q, x >> 63);
+                }
+                x = s & weights[2][q];
+                if (x != 0) {
+                    add_word(i+1, w, q, x >> 1);
+                    if (w > 0) add_word(i+1, w - 1, q, x << 63);
+                }
+                x = r & weights[3][q];
+                if (x != 0) add_word(i+1, w, q, x);
+            }
+        }
+        if (not done) tally.frontier = std::max(tally.frontier, i + j_range[i]);
+        tally.max_j_range = std::max(tally.max_j_range, j_range[i]);
+        return done;
+    }
+};
+
+}
+
+// Sweeps the bit planes until the pile is stable or reaches a sink it
+// could grow past, then hands the pile back in its cells.  Grains still at
+// the source get chain sweeps first.
+int pile::run_sliced() {
+    at_tail = false;
+    std::vector<std::mutex> column_guard(nodes.width);
+    int phases = 0;
+    bool done = false;
+    while (not done and not at_edge and reservoir != 0) {
+        sweep_tally tally;
+        done = stabilize_grid(column_guard, tally);
+        telemetry.publish(0, tally);
+        if (tally.lost != 0 and can_grow()) at_edge = true;
+        phases++;
+    }
+    if (not done and not at_edge) {
+        sliced_octant cells(nodes.width);
+        cells.pack(nodes);
+        while (not done) {
+            PROFILE_SCOPE("bit sliced sweep");
+            sliced_sweep sweep{cells, j_range, sweep_tally()};
+            done = true;
+            for (int i = 0; i < i_range; i++) {
+                done &= sweep.topple(i, odometer_column(i));
+            }
+            telemetry.publish(0, sweep.tally);
+            phases++;
+            if (sweep.tally.lost != 0 and can_grow()) {
+                at_edge = true;
+                break;
+            }
+        }
+        cells.unpack(nodes);
+    }
+    mark_all_dirty();
+    std::cout << phases << " bit sliced sweeps" << std::endl;
+    sweeps += phases;
+    return phases;
+}
@@ -0,0 +1,32 @@
+#ifndef SLICED_H
+#define SLICED_H
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "octant.h"
+
+// Octant of a low pile as bit planes: bit j % 64 of word j / 64 of plane p
+// holds bit p of height (i, j).  Three planes hold heights up to 7, and a
+// column topples 64 cells a word at a time.  Whatever a cell holds past 7
+// waits, in multiples of 8, in a per column overflow list,
+// and the sinks, which only ever fill up, keep plain counts of their own.
+// Columns are laid out in the same sheared coordinates as octant.
+struct sliced_octant {
+    static constexpr int planes = 3;
+    static constexpr cell_t below = 1u << planes;
+    int width;
+    std::vector<std::size_t> offsets;   // first word of column i, planes in turn
+    std::vector<std::uint64_t> bits;
+    std::vector<std::vector<std::pair<int, cell_t>>> overflow;
+    std::vector<cell_t> sinks;          // the last cell of every column
+    explicit sliced_octant(int width);
+    int length(int i) const { return width - i; }
+    int words(int i) const { return (length(i) + 63) / 64; }
+    std::uint64_t *plane(int i, int p) { return bits.data() + offsets[i] + p * words(i); }
+    cell_t get(int i, int j) const;
+    void pack(const octant &nodes);
+    void unpack(octant &nodes) const;
+};
+
+#endif
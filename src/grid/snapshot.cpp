@@ -0,0 +1,266 @@
+#include "snapshot.h"
+#include "profile.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <utility>
+
+static std::uint32_t dtype_of_cell() {
+    switch (sizeof(cell_t)) {
+        case 1: return dtype_uint8;
+        case 2: return dtype_uint16;
+        case 8: return dtype_uint64;
+        default: return dtype_uint32;
+    }
+}
+
+snapshot make_snapshot(const pile &sandpile, bool with_odometer) {
+    snapshot shot;
+    std::memset(&shot.header, 0, sizeof(shot.header));
+    std::memcpy(shot.header.magic, "SANDPILE", 8);
+    shot.header.version = snapshot_version;
+    shot.header.header_size = sizeof(snapshot_header);
+    shot.header.width = sandpile.nodes.width;
+    shot.header.dtype = dtype_of_cell();
+    shot.header.symmetry = symmetry_octant;
+    shot.header.sweeps = sandpile.sweeps;
+    shot.header.reservoir = sandpile.reservoir;
+    // laid out for exactly this width, whatever room the pile has to grow
+    shot.offsets = octant::layout(sandpile.nodes.width, sandpile.nodes.width);
+    shot.header.cells = shot.offsets.back();
+    shot.cells.resize(shot.header.cells);
+    if (with_odometer and not sandpile.odometer.empty()) {
+        shot.header.flags |= snapshot_has_odometer;
+        shot.odometer.resize(shot.header.cells);
+    }
+    return shot;
+}
+
+void copy_column(snapshot &shot, const pile &sandpile, int i) {
+    std::size_t from = sandpile.nodes.offsets[i];
+    std::size_t to = shot.offsets[i];
+    std::size_t length = shot.offsets[i+1] - to;
+    std::copy(sandpile.nodes.cells + from, sandpile.nodes.cells + from + length,
+              shot.cells.begin() + to);
+    if (not shot.odometer.empty()) {
+        std::copy(sandpile.odometer.begin() + from,
+                  sandpile.odometer.begin() + from + length,
+                  shot.odometer.begin() + to);
+    }
+}
+
+snapshot take_snapshot(const pile &sandpile, bool with_odometer) {
+    snapshot shot = make_snapshot(sandpile, with_odometer);
+    for (int i = 0; i < sandpile.nodes.width; i++) {
+        copy_column(shot, sandpile, i);
+    }
+    return shot;
+}
+
+static std::uint64_t count_grains(const snapshot &shot) {
+    int width = shot.header.width;
+    std::uint64_t grains = shot.header.reservoir;
+    std::size_t offset = 0;
+    for (int i = 0; i < width; i++) {
+        for (int j = 0; j < width - i; j++) {
+            std::uint64_t multiplicity = (i == 0 and j == 0) ? 1 :
+                                         (i == 0 or j == 0) ? 4 : 8;
+            grains += multiplicity * shot.cells[offset + j];
+        }
+        offset += (width - i + octant::pad - 1) / octant::pad * octant::pad;
+    }
+    return grains;
+}
+
+// large writes straight from the buffers, retried until all of it is out
+static bool write_all(int fd, const void *data, std::size_t bytes) {
+    const char *p = static_cast<const char*>(data);
+    const std::size_t chunk = 8 << 20;
+    while (bytes > 0) {
+        ssize_t written = ::write(fd, p, std::min(bytes, chunk));
+        if (written < 0) return false;
+        p += written;
+        bytes -= written;
+    }
+    return true;
+}
+
+bool write_snapshot(const snapshot &shot, const std::string &path) {
+    PROFILE_SCOPE("snapshot write");
+    snapshot_header header = shot.header;
+    header.grains = count_grains(shot);
+    std::string tmp = path + ".tmp";
+    int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        std::cout << "cannot open " << tmp << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    bool ok = write_all(fd, &header, sizeof(header)) and
+              write_all(fd, shot.cells.data(), shot.cells.size() * sizeof(cell_t)) and
+              write_all(fd, shot.odometer.data(),
+                        shot.odometer.size() * sizeof(std::uint64_t)) and
+              ::fsync(fd) == 0;
+    ok &= ::close(fd) == 0;
+    ok = ok and std::rename(tmp.c_str(), path.c_str()) == 0;
+    if (not ok) {
+        std::cout << "writing " << path << " failed: " << std::strerror(errno) << std::endl;
+    }
+    return ok;
+}
+
+SnapshotWriter::SnapshotWriter(std::string path) :
+    path(std::move(path)),
+    has_pending(false),
+    writing(false),
+    not_done(true) {
+    thread = std::thread(&SnapshotWriter::writer_loop, this);
+}
+
+SnapshotWriter::~SnapshotWriter() {
+    wait();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        not_done = false;
+    }
+    writer_cv.notify_one();
+    thread.join();
+}
+
+void SnapshotWriter::writer_loop() {
+    while (true) {
+        snapshot shot;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            writer_cv.wait(lock, [this] { return has_pending or not not_done; });
+            if (not has_pending) return;
+            shot = std::move(pending);
+            has_pending = false;
+            writing = true;
+        }
+        write_snapshot(shot, path);
+        std::lock_guard<std::mutex> lock(mutex);
+        writing = false;
+        idle_cv.notify_all();
+    }
+}
+
+void SnapshotWriter::submit(snapshot shot) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending = std::move(shot);
+        has_pending = true;
+    }
+    writer_cv.notify_one();
+}
+
+void SnapshotWriter::wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    idle_cv.wait(lock, [this] { return not has_pending and not writing; });
+}
+
+static bool check_header(const snapshot_header &header, const std::string &path) {
+    const char *problem = nullptr;
+    if (std::memcmp(header.magic, "SANDPILE", 8) != 0) {
+        problem = "not a sandpile snapshot";
+    } else if (header.version != snapshot_version or
+               header.header_size != sizeof(snapshot_header)) {
+        problem = "unsupported snapshot version";
+    } else if (header.dtype != dtype_of_cell()) {
+        problem = "snapshot cell type differs from this build";
+    } else if (header.symmetry != symmetry_octant) {
+        problem = "unsupported snapshot symmetry";
+    } else if (header.width < 4) {
+        problem = "bad snapshot width";
+    }
+    if (problem != nullptr) {
+        std::cout << path << ": " << problem << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool read_snapshot_header(const std::string &path, snapshot_header &header) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cout << "cannot open " << path << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    ssize_t got = ::read(fd, &header, sizeof(header));
+    ::close(fd);
+    if (got != sizeof(header)) {
+        std::cout << path << ": truncated snapshot" << std::endl;
+        return false;
+    }
+    return check_header(header, path);
+}
+
+bool load_snapshot(const std::string &path, pile &sandpile) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cout << "cannot open " << path << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    struct stat info;
+    if (::fstat(fd, &info) != 0 or info.st_size < (off_t)sizeof(snapshot_header)) {
+        std::cout << path << ": truncated snapshot" << std::endl;
+        ::close(fd);
+        return false;
+    }
+    void *map = ::mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        std::cout << "cannot map " << path << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    ::madvise(map, info.st_size, MADV_SEQUENTIAL);
+
+    const snapshot_header &header = *static_cast<const snapshot_header*>(map);
+    bool has_odometer = header.flags & snapshot_has_odometer;
+    std::vector<std::size_t> offsets = octant::layout(sandpile.nodes.width,
+                                                      sandpile.nodes.width);
+    std::size_t cells = offsets.back();
+    std::size_t expected = sizeof(header) + cells * sizeof(cell_t) +
+                           (has_odometer ? cells * sizeof(std::uint64_t) : 0);
+    bool ok = check_header(header, path);
+    if (ok and (header.width != sandpile.nodes.width or header.cells != cells or
+                (std::size_t)info.st_size != expected)) {
+        std::cout << path << ": snapshot does not match a pile of width " <<
+                     sandpile.nodes.width << std::endl;
+        ok = false;
+    }
+    if (ok) {
+        const char *payload = static_cast<const char*>(map) + sizeof(header);
+        const cell_t *from = reinterpret_cast<const cell_t*>(payload);
+        const std::uint64_t *odometer =
+            reinterpret_cast<const std::uint64_t*>(payload + cells * sizeof(cell_t));
+        if (has_odometer) sandpile.enable_odometer();
+        for (int i = 0; i < sandpile.nodes.width; i++) {
+            std::size_t length = offsets[i+1] - offsets[i];
+            std::memcpy(sandpile.nodes.column(i), from + offsets[i],
+                        length * sizeof(cell_t));
+            if (has_odometer) {
+                std::memcpy(sandpile.odometer_column(i), odometer + offsets[i],
+                            length * sizeof(std::uint64_t));
+            }
+        }
+        sandpile.sweeps = header.sweeps;
+        sandpile.reservoir = header.reservoir;
+        for (int i = 0; i < sandpile.nodes.width; i++) {
+            int last = 0;
+            for (int j = 0; j < sandpile.nodes.length(i); j++) {
+                if (sandpile.nodes(i, j) != 0) last = j;
+            }
+            sandpile.j_range[i] = std::min(std::max(2, last + 1),
+                                           sandpile.nodes.length(i) - 1);
+        }
+        sandpile.mark_all_dirty();
+    }
+    ::munmap(map, info.st_size);
+    return ok;
+}
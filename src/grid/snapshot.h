@@ -0,0 +1,93 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "pile.h"
+
+// Binary pile snapshots.  A file is a 64 byte header followed by the raw
+// padded buffer of an octant exactly header.width wide (header.cells cells
+// of header.dtype, native byte order) and, if flagged, the odometer laid
+// out the same way.  The payload starts on a cache line, so a loader can
+// map the file and copy columns straight into the octant.  Column offsets
+// follow from the width alone, see octant::layout.
+
+enum snapshot_dtype : std::uint32_t {
+    dtype_uint8 = 1,
+    dtype_uint16 = 2,
+    dtype_uint32 = 3,
+    dtype_uint64 = 4,
+};
+
+// the only symmetry so far: one octant of the square lattice
+const std::uint32_t symmetry_octant = 8;
+const std::uint32_t snapshot_has_odometer = 1;
+const std::uint32_t snapshot_version = 1;
+
+struct snapshot_header {
+    char magic[8];              // "SANDPILE"
+    std::uint32_t version;
+    std::uint32_t header_size;
+    std::int32_t width;
+    std::uint32_t dtype;
+    std::uint32_t symmetry;
+    std::uint32_t flags;
+    std::uint64_t grains;       // grains on the plane when written, reservoir included
+    std::uint64_t sweeps;       // sweeps done so far, see pile::sweeps
+    std::uint64_t cells;        // payload cells, padding included
+    std::uint64_t reservoir;    // grains still held back at the source
+};
+static_assert(sizeof(snapshot_header) == 64, "snapshot header is one cache line");
+
+struct snapshot {
+    snapshot_header header;
+    std::vector<std::size_t> offsets;   // of the columns in cells
+    std::vector<cell_t> cells;
+    std::vector<std::uint64_t> odometer;
+};
+
+// an empty snapshot the size of sandpile, filled by copy_column; frames
+// leave the odometer out
+snapshot make_snapshot(const pile &sandpile, bool with_odometer = true);
+void copy_column(snapshot &shot, const pile &sandpile, int i);
+// a full copy; only safe while nothing is stabilizing sandpile
+snapshot take_snapshot(const pile &sandpile, bool with_odometer = true);
+
+// Writes snapshots on its own thread.  Each one goes to path.tmp first and
+// is renamed over path once it is on disk, so path always holds a whole
+// snapshot.  A snapshot submitted while another one is still being written
+// replaces any that is waiting; only the newest one matters.
+class SnapshotWriter {
+private:
+    std::mutex mutex;
+    std::condition_variable writer_cv;
+    std::condition_variable idle_cv;
+    std::thread thread;
+    std::string path;
+    snapshot pending;
+    bool has_pending;
+    bool writing;
+    bool not_done;
+    void writer_loop();
+public:
+    explicit SnapshotWriter(std::string path);
+    ~SnapshotWriter();
+    SnapshotWriter(const SnapshotWriter &) = delete;
+    SnapshotWriter &operator=(const SnapshotWriter &) = delete;
+    void submit(snapshot shot);
+    // blocks until everything submitted so far is on disk
+    void wait();
+};
+
+bool write_snapshot(const snapshot &shot, const std::string &path);
+// header only, to size the pile before load_snapshot
+bool read_snapshot_header(const std::string &path, snapshot_header &header);
+// Fills a pile of header.width from the file and readies it to resume:
+// j_range covers every nonzero cell and all tiles are dirty.
+bool load_snapshot(const std::string &path, pile &sandpile);
+
+#endif
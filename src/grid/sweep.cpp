@@ -0,0 +1,26 @@
+#include "sweep.h"
+#include <algorithm>
+
+std::vector<std::vector<std::uint64_t>>
+split_sweeps(const std::vector<std::uint64_t> &counts, int jobs) {
+    std::vector<std::vector<std::uint64_t>> sweeps(
+        std::max<std::size_t>(1, std::min<std::size_t>(jobs, counts.size())));
+    // from the top down, so every sweep ends on one of the largest counts
+    for (std::size_t k = 0; k < counts.size(); k++) {
+        std::size_t from_top = counts.size() - 1 - k;
+        sweeps[from_top % sweeps.size()].push_back(counts[k]);
+    }
+    return sweeps;
+}
+
+void sweep_grains(pile &sandpile, const std::vector<std::uint64_t> &counts,
+                  const std::function<void(pile &)> &stabilize,
+                  const std::function<void(pile &, std::uint64_t)> &done) {
+    std::uint64_t dropped = 0;
+    for (std::uint64_t grains : counts) {
+        sandpile.add_grains(grains - dropped);
+        dropped = grains;
+        stabilize(sandpile);
+        done(sandpile, grains);
+    }
+}
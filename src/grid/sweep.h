@@ -0,0 +1,27 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include "pile.h"
+
+// Grain count sweeps.  By the abelian property the stable pile for N + M
+// grains is the stable pile for N with M more grains at the origin,
+// stabilized again.  A sweep over increasing counts therefore carries one
+// pile from each count to the next, and costs about as much as its largest
+// count alone.
+
+// Splits increasing counts into at most jobs independent sweeps, dealt out
+// from the largest down, so the largest counts land in different sweeps.
+std::vector<std::vector<std::uint64_t>>
+split_sweeps(const std::vector<std::uint64_t> &counts, int jobs);
+
+// Takes sandpile through counts in increasing order, each time adding the
+// grains the last count lacked and calling stabilize on it, then done with
+// the stable pile and its count.  sandpile starts out empty.
+void sweep_grains(pile &sandpile, const std::vector<std::uint64_t> &counts,
+                  const std::function<void(pile &)> &stabilize,
+                  const std::function<void(pile &, std::uint64_t)> &done);
+
+#endif
@@ -0,0 +1,78 @@
+#include "telemetry.h"
+#include <algorithm>
+#include <iostream>
+
+static void raise_to(std::atomic<int> &value, int to) {
+    int seen = value.load(std::memory_order_relaxed);
+    while (seen < to and
+           not value.compare_exchange_weak(seen, to, std::memory_order_relaxed)) { }
+}
+
+void Telemetry::publish(int worker, const sweep_tally &tally, int sweeps) {
+    worker_counters &own = counters[worker % slots];
+    own.topples.fetch_add(tally.topples, std::memory_order_relaxed);
+    own.sweeps.fetch_add(sweeps, std::memory_order_relaxed);
+    own.lost.fetch_add(tally.lost, std::memory_order_relaxed);
+    raise_to(own.frontier, tally.frontier);
+    raise_to(own.max_j_range, tally.max_j_range);
+}
+
+telemetry_totals Telemetry::read() const {
+    telemetry_totals totals;
+    for (const worker_counters &c : counters) {
+        totals.topples += c.topples.load(std::memory_order_relaxed);
+        totals.sweeps += c.sweeps.load(std::memory_order_relaxed);
+        totals.lost += c.lost.load(std::memory_order_relaxed);
+        totals.frontier = std::max(totals.frontier,
+                                   c.frontier.load(std::memory_order_relaxed));
+        totals.max_j_range = std::max(totals.max_j_range,
+                                      c.max_j_range.load(std::memory_order_relaxed));
+    }
+    return totals;
+}
+
+StatsWriter::StatsWriter(const Telemetry &telemetry, const std::string &path,
+                         double interval) :
+    telemetry(telemetry),
+    out(path, std::ios::app),
+    interval(interval),
+    start(std::chrono::steady_clock::now()),
+    last_seconds(0),
+    last_topples(telemetry.read().topples),
+    not_done(true) {
+    if (not out) std::cout << "cannot write stats to " << path << std::endl;
+    thread = std::thread(&StatsWriter::writer_loop, this);
+}
+
+StatsWriter::~StatsWriter() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        not_done = false;
+    }
+    stop_cv.notify_one();
+    thread.join();
+    write_line();
+}
+
+void StatsWriter::write_line() {
+    telemetry_totals totals = telemetry.read();
+    double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+    double rate = seconds > last_seconds ?
+        (totals.topples - last_topples) / (seconds - last_seconds) : 0;
+    last_seconds = seconds;
+    last_topples = totals.topples;
+    out << "{\"seconds\": " << seconds << ", \"sweeps\": " << totals.sweeps
+        << ", \"topples\": " << totals.topples << ", \"topples_per_sec\": "
+        << rate << ", \"lost\": " << totals.lost << ", \"frontier\": "
+        << totals.frontier << ", \"max_j_range\": " << totals.max_j_range
+        << "}" << std::endl;
+}
+
+void StatsWriter::writer_loop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (not stop_cv.wait_for(lock, std::chrono::duration<double>(interval),
+                                [this] { return not not_done; })) {
+        write_line();
+    }
+}
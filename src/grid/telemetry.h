@@ -0,0 +1,82 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Progress of the stabilizers without stopping them.  Every worker keeps
+// its own counters, each set alone on a cache line, and adds a sweep's
+// tally to them once the sweep is done; nothing on the toppling path
+// touches them.  Readers add the slots up with relaxed loads, at a cost set
+// by the number of slots, not by the size of the grid.
+
+// what one sweep of one worker did
+struct sweep_tally {
+    std::uint64_t topples = 0;  // plane topplings
+    std::uint64_t lost = 0;     // plane grains toppled into the sink
+    int frontier = 0;           // largest i + j_range[i], the pile's radius
+    int max_j_range = 0;
+};
+
+struct alignas(64) worker_counters {
+    std::atomic<std::uint64_t> topples{0};
+    std::atomic<std::uint64_t> sweeps{0};
+    std::atomic<std::uint64_t> lost{0};
+    std::atomic<int> frontier{0};
+    std::atomic<int> max_j_range{0};
+};
+
+struct telemetry_totals {
+    std::uint64_t topples = 0;
+    std::uint64_t sweeps = 0;
+    std::uint64_t lost = 0;
+    int frontier = 0;
+    int max_j_range = 0;
+};
+
+class Telemetry {
+public:
+    // workers past the last slot share slots, which costs only contention
+    static const int slots = 64;
+    // adds a sweep to worker's slot; sweeps is 0 for workers that share a
+    // sweep another worker already counted
+    void publish(int worker, const sweep_tally &tally, int sweeps = 1);
+    telemetry_totals read() const;
+private:
+    worker_counters counters[slots];
+};
+
+// One JSON object per line, every interval seconds on a thread of its own,
+// and once more when it is destroyed:
+//   {"seconds": 1.0, "sweeps": 3, "topples": 1200, "topples_per_sec": 1200,
+//    "lost": 0, "frontier": 40, "max_j_range": 30}
+class StatsWriter {
+private:
+    const Telemetry &telemetry;
+    std::ofstream out;
+    double interval;
+    std::chrono::steady_clock::time_point start;
+    double last_seconds;
+    std::uint64_t last_topples;
+    std::mutex mutex;
+    std::condition_variable stop_cv;
+    bool not_done;
+    std::thread thread;
+    void write_line();
+    void writer_loop();
+public:
+    StatsWriter(const Telemetry &telemetry, const std::string &path,
+                double interval = 1);
+    ~StatsWriter();
+    StatsWriter(const StatsWriter &) = delete;
+    StatsWriter &operator=(const StatsWriter &) = delete;
+    bool good() const { return bool(out); }
+};
+
+#endif
@@ -1 +1,2 @@
 g++ -std=c++17 -pthread test.cpp 
+g++ -O2 -std=c++17 -pthread test_pile.cpp pile.cpp tiles.cpp octant.cpp kernel.cpp pool.cpp telemetry.cpp warmstart.cpp snapshot.cpp frames.cpp render.cpp pyramid.cpp compact.cpp driven.cpp sweep.cpp profile.cpp sliced.cpp procs.cpp -o test_pile
@@ -0,0 +1,695 @@
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <vector>
+#include <string>
+#include "pile.h"
+#include "warmstart.h"
+#include "snapshot.h"
+#include "render.h"
+#include "compact.h"
+#include "driven.h"
+#include "frames.h"
+#include "pyramid.h"
+#include "sweep.h"
+#include "sliced.h"
+
+static int failures = 0;
+
+static void check(bool ok, const std::string &what)
+{
+    std::cout << (ok ? "ok   " : "FAIL ") << what << std::endl;
+    if (not ok) failures++;
+}
+
+static bool same_cells(const pile &a, const pile &b)
+{
+    if (a.nodes.width != b.nodes.width) return false;
+    for (int i = 0; i < a.nodes.width; i++) {
+        for (int j = 0; j < a.nodes.length(i); j++) {
+            if (a.nodes(i, j) != b.nodes(i, j)) return false;
+        }
+    }
+    return true;
+}
+
+static void test_run_kernels()
+{
+    std::mt19937 rng(1);
+    std::uniform_int_distribution<cell_t> height(0, 40);
+    const int n = 203;
+    for (const char *name: {"avx2", "avx512"}) {
+        run_kernel kernel = kernel_by_name(name);
+        if (kernel == nullptr) {
+            std::cout << "skip " << name << " not supported" << std::endl;
+            continue;
+        }
+        bool ok = true;
+        for (int lo = 2; lo < 20; lo++) {
+            std::vector<cell_t> column(n + 1), left(n + 1), right(n + 1);
+            for (int j = 0; j <= n; j++) {
+                column[j] = height(rng);
+                left[j] = height(rng);
+                right[j] = height(rng);
+            }
+            std::vector<cell_t> column2(column), left2(left), right2(right);
+            std::uint64_t a = topple_run_scalar(column.data(), left.data(),
+                                                right.data(), nullptr, lo, n - lo % 7);
+            std::uint64_t b = kernel(column2.data(), left2.data(), right2.data(),
+                                     nullptr, lo, n - lo % 7);
+            ok &= a == b and column == column2 and left == left2 and
+                  right == right2;
+        }
+        check(ok, std::string(name) + " run kernel matches scalar");
+
+        // cells near 2^30, as the reservoir keeps them, topple past 2^32 in a run
+        std::vector<cell_t> tall(n + 1, 1u << 30), left(n + 1), right(n + 1);
+        std::uint64_t topples = kernel(tall.data(), left.data(), right.data(),
+                                       nullptr, 2, n);
+        check(topples == std::uint64_t(n - 2) << 28,
+              std::string(name) + " run kernel counts topplings past 2^32");
+    }
+}
+
+static void test_kernels_stabilize_alike()
+{
+    pile reference(120);
+    reference.kernel = topple_run_scalar;
+    reference.nodes(0, 0) = 20000;
+    reference.stabilize();
+    pile fast(120);
+    fast.nodes(0, 0) = 20000;
+    fast.stabilize();
+    check(same_cells(reference, fast),
+          std::string(kernel_name(fast.kernel)) + " pile matches scalar pile");
+}
+
+static void test_bands_match_chain()
+{
+    pile reference(150);
+    reference.nodes(0, 0) = 30000;
+    reference.stabilize();
+    for (int threads: {1, 2, 3, 7}) {
+        ThreadPool pool(threads);
+        pile banded(150);
+        banded.nodes(0, 0) = 30000;
+        banded.stabilize_bands(pool);
+        check(same_cells(reference, banded),
+              std::to_string(threads) + " band pile matches chain pile");
+    }
+}
+
+static void test_tiles_match_chain()
+{
+    pile reference(150);
+    reference.enable_odometer();
+    reference.nodes(0, 0) = 30000;
+    reference.stabilize();
+    for (int threads: {1, 2, 5}) {
+        ThreadPool pool(threads);
+        pile tiled(150);
+        tiled.enable_odometer();
+        tiled.nodes(0, 0) = 30000;
+        tiled.stabilize_tiles(pool);
+        check(same_cells(reference, tiled) and reference.odometer == tiled.odometer,
+              std::to_string(threads) + " thread tile pile matches chain pile");
+        check(tiled.telemetry.read().topples == reference.telemetry.read().topples,
+              std::to_string(threads) + " thread tile pile topples as often");
+    }
+    // grains added to the stable pile afterwards, and a pile that grows
+    ThreadPool pool(3);
+    pile more(150), grown(40, 150);
+    more.nodes(0, 0) = 20000;
+    grown.nodes(0, 0) = 30000;
+    more.stabilize_tiles(pool);
+    more.nodes(0, 0) += 10000;
+    more.stabilize(2);
+    grown.stabilize_tiles(pool);
+    bool same = true;
+    for (int i = 0; i < grown.nodes.width; i++) {
+        for (int j = 0; j < grown.nodes.length(i); j++) {
+            same &= grown.nodes(i, j) == reference.nodes(i, j);
+        }
+    }
+    check(same_cells(reference, more), "chain finishes after tiles");
+    check(same and grown.nodes.width > 40, "tile pile grows");
+}
+
+static void test_processes_match_chain()
+{
+    pile reference(150);
+    reference.enable_odometer();
+    reference.nodes(0, 0) = 30000;
+    reference.stabilize();
+    for (int processes: {1, 3}) {
+        pile forked(150);
+        forked.enable_odometer();
+        forked.add_grains(30000);
+        forked.stabilize_processes(processes);
+        check(same_cells(reference, forked) and reference.odometer == forked.odometer,
+              std::to_string(processes) + " process pile matches chain pile");
+        check(forked.telemetry.read().topples == reference.telemetry.read().topples,
+              std::to_string(processes) + " process pile topples as often");
+    }
+    // grains from the reservoir, a pile that grows, and the chain after it
+    pile grown(40, 150);
+    grown.reservoir_chunk = 1000;
+    grown.add_grains(20000);
+    check(grown.stabilize_processes(2) > 0 and grown.nodes.width > 40 and
+          grown.reservoir == 0, "process pile drains the reservoir and grows");
+    grown.add_grains(10000);
+    grown.stabilize(2);
+    bool same = true;
+    for (int i = 0; i < grown.nodes.width; i++) {
+        for (int j = 0; j < grown.nodes.length(i); j++) {
+            same &= grown.nodes(i, j) == reference.nodes(i, j);
+        }
+    }
+    check(same, "chain finishes after processes");
+}
+
+static void test_sliced_tail()
+{
+    pile reference(150);
+    reference.enable_odometer();
+    reference.sliced_tail = false;
+    reference.nodes(0, 0) = 30000;
+    reference.stabilize(1);
+    for (int threads: {1, 3}) {
+        pile tail(150);
+        tail.enable_odometer();
+        tail.nodes(0, 0) = 30000;
+        tail.stabilize(threads);
+        check(same_cells(reference, tail) and reference.odometer == tail.odometer,
+              std::to_string(threads) + " thread chain with a bit sliced tail matches");
+        check(tail.telemetry.read().topples == reference.telemetry.read().topples,
+              std::to_string(threads) + " thread bit sliced tail topples as often");
+    }
+    // straight from the source, chain sweeps first; and a pile that grows
+    pile direct(150), grown(20, 150);
+    direct.add_grains(30000);
+    direct.run_sliced();
+    grown.nodes(0, 0) = 30000;
+    grown.stabilize(1);
+    bool same = grown.nodes.width > 20;
+    for (int i = 0; i < grown.nodes.width; i++) {
+        for (int j = 0; j < grown.nodes.length(i); j++) {
+            same &= grown.nodes(i, j) == reference.nodes(i, j);
+        }
+    }
+    check(same_cells(reference, direct), "bit sliced sweeps from the source");
+    check(same, "bit sliced tail of a growing pile");
+
+    // cells past 7 wait on the overflow list, sinks keep their counts
+    sliced_octant cells(40);
+    pile low(40), copy(40);
+    for (int i = 0; i < 40; i++) {
+        for (int j = 0; j < low.nodes.length(i); j++) low.nodes(i, j) = (i * 7 + j) % 8;
+        low.nodes(i, low.nodes.length(i) - 1) = 1000 + i;
+    }
+    low.nodes(3, 5) = 29;
+    cells.pack(low.nodes);
+    cells.unpack(copy.nodes);
+    check(same_cells(low, copy) and cells.overflow[3].size() == 1,
+          "bit planes unpack to the same cells");
+}
+
+static void test_tiles_clean_after_stabilize()
+{
+    ThreadPool pool(2);
+    pile sandpile(200);
+    sandpile.nodes(0, 0) = 5000;
+    sandpile.stabilize_bands(pool);
+    check(sandpile.active_tiles() == 0, "no dirty tiles once stable");
+    check(sandpile.stabilize_bands(pool) == 1, "stable pile takes one sweep");
+}
+
+static void test_warm_start_matches_cold_start()
+{
+    for (unsigned int grains: {1000u, 30000u, 100000u}) {
+        pile cold(260);
+        cold.enable_odometer();
+        cold.nodes(0, 0) = grains;
+        cold.stabilize();
+        pile warm(260);
+        warm.enable_odometer();
+        warm.nodes(0, 0) = grains;
+        warm_start_stats stats = warm_start(warm);
+        warm.stabilize();
+        check(stats.topples > 0 and same_cells(cold, warm),
+              "warm start of " + std::to_string(grains) + " grains matches");
+        check(cold.odometer == warm.odometer,
+              "warm start odometer of " + std::to_string(grains) + " grains");
+    }
+}
+
+static void test_resume_from_checkpoint()
+{
+    const std::string path = "test_pile.snap";
+    pile reference(180);
+    reference.enable_odometer();
+    reference.nodes(0, 0) = 40000;
+    reference.stabilize();
+
+    // a checkpoint after every phase; the last one written is mid-run
+    ThreadPool pool(3);
+    pile first(180);
+    first.enable_odometer();
+    first.nodes(0, 0) = 40000;
+    {
+        SnapshotWriter writer(path);
+        first.checkpoint = &writer;
+        first.checkpoint_interval = 0;
+        first.stabilize_bands(pool);
+    }
+    snapshot_header header;
+    bool ok = read_snapshot_header(path, header);
+    check(ok and header.width == 180 and header.grains == 40000 and
+          header.sweeps > 0, "checkpoint header");
+    pile resumed(header.width);
+    ok = load_snapshot(path, resumed);
+    resumed.stabilize();
+    check(ok and same_cells(reference, resumed) and
+          reference.odometer == resumed.odometer,
+          "pile resumed from a checkpoint matches");
+
+    check(write_snapshot(take_snapshot(reference), path) and
+          load_snapshot(path, resumed) and same_cells(reference, resumed) and
+          resumed.sweeps == reference.sweeps, "snapshot round trip");
+    pile narrow(100);
+    check(not load_snapshot(path, narrow), "snapshot of another width refused");
+    std::remove((path + ".tmp").c_str());
+    std::remove(path.c_str());
+}
+
+static void test_reservoir_at_source()
+{
+    pile reference(150);
+    reference.nodes(0, 0) = 60000;
+    reference.stabilize();
+    std::uint64_t topples = reference.telemetry.read().topples;
+
+    ThreadPool pool(3);
+    for (const char *engine: {"chain", "bands", "tiles", "warm"}) {
+        pile sandpile(150);
+        sandpile.reservoir_chunk = 1000;
+        sandpile.add_grains(60000);
+        bool held = sandpile.nodes(0, 0) == 1000 and sandpile.reservoir == 59000;
+        std::string name = engine;
+        if (name == "bands") {
+            sandpile.stabilize_bands(pool);
+        } else if (name == "tiles") {
+            sandpile.stabilize_tiles(pool);
+        } else {
+            if (name == "warm") warm_start(sandpile, 3);
+            sandpile.stabilize(2);
+        }
+        check(held and sandpile.reservoir == 0 and same_cells(reference, sandpile) and
+              (name == "warm" or sandpile.telemetry.read().topples == topples),
+              name + " pile fed from the reservoir matches");
+    }
+
+    // a snapshot taken while grains still wait keeps them
+    const std::string path = "test_pile.snap";
+    pile first(150);
+    first.reservoir_chunk = 1000;
+    first.add_grains(60000);
+    pile resumed(150);
+    snapshot_header header;
+    bool ok = write_snapshot(take_snapshot(first), path) and
+              read_snapshot_header(path, header) and load_snapshot(path, resumed);
+    resumed.reservoir_chunk = 1000;
+    check(ok and header.grains == 60000 and resumed.reservoir == 59000,
+          "snapshot keeps the reservoir");
+    resumed.stabilize();
+    check(same_cells(reference, resumed), "pile resumed with a reservoir matches");
+    std::remove(path.c_str());
+}
+
+static void test_grain_sweep()
+{
+    const std::vector<std::uint64_t> counts = {1000, 5000, 20000, 21000};
+    std::vector<std::vector<std::uint64_t>> sweeps = split_sweeps(counts, 2);
+    check(sweeps.size() == 2 and sweeps[0] == std::vector<std::uint64_t>{5000, 21000} and
+          sweeps[1] == std::vector<std::uint64_t>{1000, 20000} and
+          split_sweeps(counts, 9).size() == 4, "counts split over sweeps");
+
+    pile carried(110);
+    bool all_match = true;
+    int stable = 0;
+    sweep_grains(carried, counts, [](pile &sandpile) { sandpile.stabilize(2); },
+                 [&](pile &sandpile, std::uint64_t grains) {
+        pile fresh(110);
+        fresh.add_grains(grains);
+        fresh.stabilize();
+        all_match &= same_cells(fresh, sandpile);
+        stable++;
+    });
+    check(all_match and stable == 4, "swept piles match piles stabilized alone");
+}
+
+static void test_render_unfolds_octant()
+{
+    ThreadPool pool(3);
+    pile sandpile(40);
+    sandpile.nodes(0, 0) = 3000;
+    sandpile.stabilize_bands(pool);
+    palette colors = default_palette();
+    const int side = 2 * 40 - 1;
+    std::vector<std::uint32_t> pixels =
+        render_image(40, octant_rows(sandpile.nodes), pool, colors);
+    bool ok = pixels.size() == side * side;
+    for (int y = -39; ok and y < 40; y++) {
+        for (int x = -39; x < 40; x++) {
+            int ax = std::abs(x), ay = std::abs(y);
+            cell_t height = ax <= ay ? sandpile.nodes(ay - ax, ax)
+                                     : sandpile.nodes(ax - ay, ay);
+            ok &= pixels[(y + 39) * side + x + 39] == colors.colors[height];
+        }
+    }
+    check(ok, "rendered image unfolds the octant");
+
+    write_bmp("test_pile.bmp", 40, octant_rows(sandpile.nodes), pool, colors);
+    std::ifstream in("test_pile.bmp", std::ios::binary);
+    std::vector<char> bmp((std::istreambuf_iterator<char>(in)),
+                          std::istreambuf_iterator<char>());
+    check(bmp.size() == 54 + 4 * pixels.size() and
+          std::equal(pixels.begin(), pixels.end(),
+                     (const std::uint32_t*)(bmp.data() + 54)),
+          "BMP holds the rendered image");
+    std::remove("test_pile.bmp");
+}
+
+static void test_pyramid_tiles()
+{
+    ThreadPool pool(3);
+    pile sandpile(40);
+    sandpile.nodes(0, 0) = 3000;
+    sandpile.stabilize_bands(pool);
+    palette colors = default_palette();
+    const int side = 2 * 40 - 1;
+    std::vector<std::uint32_t> pixels =
+        render_image(40, octant_rows(sandpile.nodes), pool, colors);
+    auto height = [&](int c, int r) {
+        return std::find(colors.colors, colors.colors + colors.size,
+                         pixels[r * side + c]) - colors.colors;
+    };
+    // 79 pixels: levels of 1, 2, 3, 5, 10, 20, 40 and 79, in 16 pixel tiles
+    tile_pyramid mode(40, octant_spans(sandpile.nodes), true, 16);
+    tile_pyramid mean(40, octant_spans(sandpile.nodes), false, 16);
+    bool ok = mode.levels == 8 and mode.level_side(3) == 5 and mode.tiles_across(7) == 5;
+    for (int x = 0; x < 5; x++) {
+        for (int y = 0; y < 5; y++) {
+            std::vector<unsigned char> tile = mode.tile(7, x, y);
+            for (std::size_t p = 0; p < tile.size(); p++) {
+                int columns = std::min(16, side - 16 * x);
+                ok &= tile[p] == height(16 * x + p % columns, 16 * y + p / columns);
+            }
+        }
+    }
+    check(ok, "full image tiles unfold the octant");
+
+    // pixel (1, 2) of level 5 covers full image pixels 4..7 by 8..11
+    std::vector<int> counts(colors.size);
+    for (int r = 8; r < 12; r++) {
+        for (int c = 4; c < 8; c++) counts[height(c, r)]++;
+    }
+    int most = std::max_element(counts.begin(), counts.end()) - counts.begin();
+    int sum = 0;
+    for (int k = 0; k < colors.size; k++) sum += k * counts[k];
+    int steps = (mean.tile_palette().size - 1) / (colors.size - 1);
+    check(mode.tile(5, 0, 0)[2 * 16 + 1] == most and
+          mean.tile(5, 0, 0)[2 * 16 + 1] == (sum * steps + 8) / 16,
+          "zoomed out pixels take the mode or mean of the heights under them");
+
+    check(mean.write("test_pile_pyramid", pool) and
+          std::ifstream("test_pile_pyramid.dzi").good() and
+          std::ifstream("test_pile_pyramid_files/0/0_0.png").good() and
+          std::ifstream("test_pile_pyramid_files/7/4_4.png").good() and
+          not std::ifstream("test_pile_pyramid_files/6/3_0.png").good(),
+          "pyramid writes every tile of every level");
+    std::filesystem::remove_all("test_pile_pyramid_files");
+    std::remove("test_pile_pyramid.dzi");
+}
+
+static void test_frames_while_stabilizing()
+{
+    const std::string path = "test_pile.y4m";
+    const int width = 120, side = 2 * width - 1;
+    const std::size_t frame_bytes = 6 + 3 * (std::size_t)side * side;
+    ThreadPool pool(3);
+    for (const char *engine: {"chain", "bands"}) {
+        pile sandpile(width);
+        sandpile.nodes(0, 0) = 30000;
+        int written;
+        {
+            FrameWriter frames(path, width);
+            sandpile.frames = &frames;
+            sandpile.frame_interval = 0.001;
+            sandpile.frame_topples = std::string(engine) == "bands" ? 1 : 0;
+            if (std::string(engine) == "bands") {
+                sandpile.stabilize_bands(pool);
+            } else {
+                sandpile.stabilize(2);
+            }
+            frames.submit(take_snapshot(sandpile, false));
+            frames.wait();
+            written = frames.written();
+        }
+        std::ifstream in(path, std::ios::binary);
+        std::string header;
+        std::getline(in, header);
+        std::string video((std::istreambuf_iterator<char>(in)),
+                          std::istreambuf_iterator<char>());
+        std::ostringstream last;
+        write_y4m_frame(last, width, octant_rows(sandpile.nodes), pool);
+        check(header.compare(0, 14, "YUV4MPEG2 W239") == 0 and written >= 2 and
+              video.size() == written * frame_bytes and
+              video.compare(video.size() - frame_bytes, frame_bytes, last.str()) == 0,
+              std::string(engine) + " frames stream ends on the stable pile");
+        std::remove(path.c_str());
+    }
+}
+
+static void test_compact_store()
+{
+    compact_octant store(100);
+    std::mt19937 rng(3);
+    std::uniform_int_distribution<cell_t> height(0, 20);
+    std::vector<cell_t> column(100), back(100);
+    for (int j = 0; j < 70; j++) column[j] = height(rng);
+    store.pack(5, 70, column.data());
+    store.set(5, 80, 13);
+    store.unpack(5, 95, back.data());
+    column[80] = 13;
+    check(std::equal(column.begin(), column.begin() + 95, back.begin()) and
+          store.get(5, 80) == 13, "compact column round trip");
+
+    for (unsigned int grains: {777u, 20000u, 150000u}) {
+        pile reference(250);
+        reference.nodes(0, 0) = grains;
+        reference.stabilize();
+        compact_pile compact(250);
+        compact.cells.set(0, 0, grains);
+        compact.stabilize();
+        bool same = true;
+        for (int i = 0; i < 250; i++) {
+            for (int j = 0; j < reference.nodes.length(i); j++) {
+                same &= compact.cells.get(i, j) == reference.nodes(i, j);
+            }
+        }
+        check(same, "compact pile of " + std::to_string(grains) +
+              " grains matches");
+        if (grains == 150000u) {
+            check(compact.cells.bytes() * 4 < reference.nodes.size() * sizeof(cell_t),
+                  "compact pile is small");
+        }
+    }
+}
+
+// plane points folded onto octant cell (i, j)
+static std::uint64_t multiplicity(int i, int j)
+{
+    return i == 0 and j == 0 ? 1 : i == 0 or j == 0 ? 4 : 8;
+}
+
+static void test_telemetry_counts()
+{
+    const int width = 60;
+    const unsigned int grains = 30000;
+    for (int threads: {0, 1, 3}) {
+        pile sandpile(width);
+        sandpile.enable_odometer();
+        sandpile.nodes(0, 0) = grains;
+        std::string what = threads == 0 ? "chain" : std::to_string(threads) + " band";
+        if (threads == 0) {
+            sandpile.stabilize(2);
+        } else {
+            ThreadPool pool(threads);
+            sandpile.stabilize_bands(pool);
+        }
+        std::uint64_t topples = 0, lost = 0, kept = 0;
+        for (int i = 0; i < width; i++) {
+            int sink = sandpile.nodes.length(i) - 1;
+            for (int j = 0; j <= sink; j++) {
+                std::uint64_t m = multiplicity(i, j);
+                topples += m * sandpile.odometer_column(i)[j];
+                (j == sink ? lost : kept) += m * sandpile.nodes(i, j);
+            }
+        }
+        telemetry_totals stats = sandpile.telemetry.read();
+        check(stats.topples == topples, what + " telemetry counts topples");
+        check(lost > 0 and stats.lost == lost and kept + lost == grains,
+              what + " telemetry counts grains lost to the sink");
+        check(stats.sweeps == sandpile.sweeps, what + " telemetry counts sweeps");
+    }
+
+    const std::string path = "test_pile.jsonl";
+    std::remove(path.c_str());
+    pile sandpile(100);
+    sandpile.nodes(0, 0) = 20000;
+    {
+        StatsWriter writer(sandpile.telemetry, path, 0.001);
+        check(writer.good(), "stats file opens");
+        sandpile.stabilize();
+    }
+    std::ifstream in(path);
+    std::string line, last;
+    int lines = 0;
+    while (std::getline(in, line)) {
+        lines++;
+        last = line;
+    }
+    std::string topples = "\"topples\": " +
+        std::to_string(sandpile.telemetry.read().topples) + ",";
+    check(lines >= 1 and last.front() == '{' and last.back() == '}' and
+          last.find(topples) != std::string::npos, "stats file ends on the totals");
+    std::remove(path.c_str());
+}
+
+static void test_driven_pile()
+{
+    // grain by grain at the origin ends where all at once does
+    const int width = 40;
+    const unsigned int grains = 5000;
+    pile reference(width);
+    reference.enable_odometer();
+    reference.nodes(0, 0) = grains;
+    reference.stabilize();
+    driven_pile driven(width);
+    std::mt19937_64 rng(7);
+    avalanche_stats stats;
+    driven.drive(grains, false, rng, stats);
+    driven_pile unfolded(reference);
+    std::uint64_t topples = 0;
+    for (int i = 0; i < width; i++) {
+        for (int j = 0; j < reference.nodes.length(i); j++) {
+            topples += multiplicity(i, j) * reference.odometer_column(i)[j];
+        }
+    }
+    check(driven.heights == unfolded.heights, "driven pile matches one shot pile");
+    check(stats.topples == topples and stats.drops == grains,
+          "driven pile topples as often as one shot pile");
+
+    // random drops on a pile that loses grains at the edge
+    driven_pile edge(30);
+    avalanche_stats random;
+    edge.drive(100000, true, rng, random);
+    bool stable = true;
+    for (unsigned char h : edge.heights) stable &= h < 4 or h == driven_pile::sink;
+    check(stable and random.lost > 0 and
+          edge.grains() + random.lost == random.drops,
+          "random drops keep every grain");
+    std::uint64_t counted = 0;
+    for (std::uint64_t c : random.size.counts) counted += c;
+    avalanche big = edge.drop(0, 0);
+    while (big.size == 0) big = edge.drop(0, 0);
+    check(counted == random.drops and big.area <= big.size and
+          big.duration <= big.size and big.radius < 30,
+          "avalanche histograms and sizes");
+
+    // too narrow a pile is widened to one cell inside its sink ring
+    driven_pile tiny(1);
+    avalanche_stats few;
+    tiny.drive(100, false, rng, few);
+    int ring = 0;
+    for (unsigned char h : tiny.heights) ring += h == driven_pile::sink;
+    check(tiny.width == 3 and ring == 16 and tiny(0, 0) < 4 and
+          tiny.grains() + few.lost == few.drops,
+          "narrow driven pile keeps its sink ring");
+}
+
+static void test_growing_pile()
+{
+    const unsigned int grains = 30000;
+    pile reference(200);
+    reference.enable_odometer();
+    reference.nodes(0, 0) = grains;
+    reference.stabilize();
+    int reach = 0;
+    for (int i = 0; i < 200; i++) {
+        for (int j = 0; j < reference.nodes.length(i); j++) {
+            if (reference.nodes(i, j) != 0) reach = std::max(reach, i + j);
+        }
+    }
+    check(reach + 1 < width_for_grains(grains), "width sized from grains holds the pile");
+
+    for (int threads: {0, 3}) {
+        std::string what = threads == 0 ? "chain" : "band";
+        pile grown(20, 400);
+        grown.enable_odometer();
+        grown.nodes(0, 0) = grains;
+        if (threads == 0) {
+            grown.stabilize(2);
+        } else {
+            ThreadPool pool(threads);
+            grown.stabilize_bands(pool);
+        }
+        bool same = grown.nodes.width > reach + 1 and grown.nodes.width < 400;
+        for (int i = 0; i < 200; i++) {
+            for (int j = 0; j < reference.nodes.length(i); j++) {
+                bool inside = i + j < grown.nodes.width;
+                same &= reference.nodes(i, j) == (inside ? grown.nodes(i, j) : 0);
+                same &= reference.odometer_column(i)[j] ==
+                        (inside ? grown.odometer_column(i)[j] : 0);
+            }
+        }
+        check(same, what + " pile grown from 20 wide matches");
+
+        const std::string path = "test_pile.snap";
+        pile loaded(grown.nodes.width);
+        check(write_snapshot(take_snapshot(grown), path) and
+              load_snapshot(path, loaded) and same_cells(grown, loaded) and
+              loaded.odometer_column(5)[7] == grown.odometer_column(5)[7],
+              what + " grown pile snapshot round trip");
+        std::remove(path.c_str());
+    }
+}
+
+int main()
+{
+    test_run_kernels();
+    test_kernels_stabilize_alike();
+    test_bands_match_chain();
+    test_tiles_match_chain();
+    test_processes_match_chain();
+    test_sliced_tail();
+    test_tiles_clean_after_stabilize();
+    test_warm_start_matches_cold_start();
+    test_resume_from_checkpoint();
+    test_reservoir_at_source();
+    test_grain_sweep();
+    test_render_unfolds_octant();
+    test_pyramid_tiles();
+    test_frames_while_stabilizing();
+    test_compact_store();
+    test_telemetry_counts();
+    test_driven_pile();
+    test_growing_pile();
+    std::cout << failures << " failures" << std::endl;
+    return failures != 0;
+}
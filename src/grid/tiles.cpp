@@ -0,0 +1,254 @@
+#include "pile.h"
+#include "profile.h"
+#include <algorithm>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// Asynchronous stabilizer.  The octant is cut into tiles of tile_columns
+// columns by pile::tile rows.  A worker takes a tile, locks it and the
+// eight tiles around it, topples the tile for a few passes and then
+// queues the neighbours it spilled into.  Tiles that are ready wait in one
+// deque per worker: the owner works from the back, idle workers steal from
+// the front, so the work follows the activity wherever it is.  By the
+// abelian property the order does not matter, and the run is over once no
+// tile is queued or being relaxed.
+
+namespace {
+
+struct alignas(64) tile_queue {
+    std::mutex mutex;
+    std::deque<int> tiles;
+};
+
+// the neighbours a tile spilled into, one bit per direction
+enum spill : unsigned {
+    spill_left = 1,         // (a-1, b)
+    spill_left_up = 2,      // (a-1, b+1)
+    spill_right = 4,        // (a+1, b)
+    spill_right_down = 8,   // (a+1, b-1)
+    spill_up = 16,          // (a, b+1)
+    spill_down = 32,        // (a, b-1)
+    spill_self = 64,        // still unstable after its passes
+};
+
+struct tiling {
+    pile &sandpile;
+    int blocks;             // column blocks a
+    int rows;               // row blocks b
+    std::vector<std::mutex> locks;
+    std::unique_ptr<std::atomic<bool>[]> queued;
+    std::vector<tile_queue> queues;
+    std::atomic<long> pending{0};
+
+    tiling(pile &sandpile, int workers) :
+        sandpile(sandpile),
+        blocks((sandpile.i_range + pile::tile_columns - 1) / pile::tile_columns),
+        rows((sandpile.nodes.width + pile::tile - 1) / pile::tile),
+        locks(blocks * rows),
+        queued(new std::atomic<bool>[blocks * rows]),
+        queues(workers) {
+        for (int t = 0; t < blocks * rows; t++) queued[t] = false;
+    }
+
+    // whether tile (a, b) holds a cell that can topple, the sink excluded
+    bool holds_cells(int a, int b) const {
+        return a >= 0 and a < blocks and b >= 0 and
+               sandpile.nodes.length(a * pile::tile_columns) - 1 > b * pile::tile;
+    }
+
+    void push(int worker, int t) {
+        if (queued[t].exchange(true)) return;
+        pending++;
+        std::lock_guard<std::mutex> lock(queues[worker].mutex);
+        queues[worker].tiles.push_back(t);
+    }
+
+    bool take(int worker, int &t) {
+        int n = queues.size();
+        for (int k = 0; k < n; k++) {
+            tile_queue &q = queues[(worker + k) % n];
+            std::lock_guard<std::mutex> lock(q.mutex);
+            if (q.tiles.empty()) continue;
+            if (k == 0) {
+                t = q.tiles.back();
+                q.tiles.pop_back();
+            } else {
+                t = q.tiles.front();
+                q.tiles.pop_front();
+            }
+            return true;
+        }
+        return false;
+    }
+
+    // the tile and the ones around it, in id order, or none of them
+    bool lock_around(int a, int b, std::vector<int> &held) {
+        held.clear();
+        for (int da = -1; da <= 1; da++) {
+            for (int db = -1; db <= 1; db++) {
+                int na = a + da, nb = b + db;
+                if (na < 0 or na >= blocks or nb < 0 or nb >= rows) continue;
+                int n = na * rows + nb;
+                if (not locks[n].try_lock()) {
+                    for (int h : held) locks[h].unlock();
+                    held.clear();
+                    return false;
+                }
+                held.push_back(n);
+            }
+        }
+        return true;
+    }
+};
+
+}
+
+// a tile still toppling after this many passes goes back in the queue, so
+// the grains it passes to its neighbours get relaxed there in between
+static const int tile_passes = 16;
+
+// Topples tile (a, b) until it is stable, or for tile_passes passes.
+// Cells of a column never feed each other, so the first and last row are
+// toppled apart from the rest only to learn whether anything crossed into
+// the tiles above and below.
+static unsigned relax_tile(pile &sandpile, int a, int b, sweep_tally &tally) {
+    int i_lo = a * pile::tile_columns;
+    int i_hi = std::min(i_lo + pile::tile_columns, sandpile.i_range);
+    int lo = b * pile::tile, hi = lo + pile::tile;
+    unsigned spilled = 0;
+    bool toppled = true;
+    for (int pass = 0; toppled; pass++) {
+        if (pass == tile_passes) {
+            spilled |= spill_self;
+            break;
+        }
+        toppled = false;
+        // the origin's tile owns the reservoir
+        if (a == 0 and b == 0) sandpile.release_reservoir();
+        for (int i = i_lo; i < i_hi; i++) {
+            int top = std::min(hi, sandpile.nodes.length(i) - 1);
+            if (top <= lo) continue;
+            cell_t *left = i > 0 ? sandpile.nodes.column(i-1) : nullptr;
+            cell_t *right = sandpile.nodes.column(i+1);
+            // only the tile holding row edge spills into the sink cell of
+            // column i+1; any other may run apart from that one
+            int edge = sandpile.nodes.length(i) - 2;
+            bool owns_sink = top == edge + 1;
+            cell_t sink_before = owns_sink ? right[edge] : 0;
+            std::uint64_t first = sandpile.topple_range(i, left, right, lo, lo + 1);
+            std::uint64_t last = 0, middle = 0;
+            if (top - lo > 1) {
+                middle = sandpile.topple_range(i, left, right, lo + 1, top - 1);
+                last = sandpile.topple_range(i, left, right, top - 1, top);
+            }
+            std::uint64_t topples = first + middle + last;
+            if (topples == 0) continue;
+            toppled = true;
+            tally.topples += topples;
+            if (owns_sink) {
+                tally.lost += (edge == 0 ? 4 : 8) * std::uint64_t(right[edge] - sink_before);
+            }
+            tally.frontier = std::max(tally.frontier, i + top - 1);
+            tally.max_j_range = std::max(tally.max_j_range, top - 1);
+            // the last row toppling feeds row hi of column i-1 only when
+            // the tile is full height there
+            bool crossed_up = top == hi and (top - lo > 1 ? last : first) != 0;
+            bool crossed_down = lo > 0 and first != 0;
+            if (i == i_lo and i > 0) {
+                spilled |= spill_left;
+                if (crossed_up) spilled |= spill_left_up;
+            } else if (crossed_up) {
+                spilled |= spill_up;
+            }
+            if (i == i_hi - 1) {
+                spilled |= spill_right;
+                if (crossed_down) spilled |= spill_right_down;
+            } else if (crossed_down) {
+                spilled |= spill_down;
+            }
+        }
+    }
+    return spilled;
+}
+
+int pile::stabilize_tiles(ThreadPool &pool) {
+    int count = run_tiles(pool);
+    while (at_edge) {
+        grow();
+        count += run_tiles(pool);
+    }
+    return count;
+}
+
+int pile::run_tiles(ThreadPool &pool) {
+    tiling tiles(*this, pool.size());
+    at_edge = false;
+    // start from every tile holding a cell that can topple
+    int next = 0;
+    for (int a = 0; a < tiles.blocks; a++) {
+        for (int b = 0; tiles.holds_cells(a, b); b++) {
+            int i_hi = std::min((a + 1) * tile_columns, i_range);
+            bool unstable = false;
+            for (int i = a * tile_columns; i < i_hi and not unstable; i++) {
+                int top = std::min((b + 1) * tile, nodes.length(i) - 1);
+                for (int j = b * tile; j < top; j++) unstable |= nodes(i, j) >= 4;
+            }
+            unstable |= a == 0 and b == 0 and reservoir != 0;
+            if (unstable) tiles.push(next++ % pool.size(), a * tiles.rows + b);
+        }
+    }
+
+    std::atomic<int> relaxed(0);
+    pool.run([&](int worker) {
+        std::vector<int> held;
+        int count = 0;
+        while (not at_edge) {
+            int t;
+            if (not tiles.take(worker, t)) {
+                if (tiles.pending == 0) break;
+                std::this_thread::yield();
+                continue;
+            }
+            int a = t / tiles.rows, b = t % tiles.rows;
+            if (not tiles.lock_around(a, b, held)) {
+                // a neighbour is busy, try again after the rest of the queue
+                {
+                    std::lock_guard<std::mutex> lock(tiles.queues[worker].mutex);
+                    tiles.queues[worker].tiles.push_front(t);
+                }
+                std::this_thread::yield();
+                continue;
+            }
+            tiles.queued[t] = false;
+            sweep_tally tally;
+            unsigned spilled;
+            {
+                PROFILE_SCOPE("tile");
+                spilled = relax_tile(*this, a, b, tally);
+            }
+            for (int h : held) tiles.locks[h].unlock();
+            telemetry.publish(worker, tally, 0);
+            if (tally.lost != 0 and can_grow()) at_edge = true;
+            if (spilled & spill_self) tiles.push(worker, t);
+            const int moves[6][3] = {{spill_left, -1, 0}, {spill_left_up, -1, 1},
+                                     {spill_right, 1, 0}, {spill_right_down, 1, -1},
+                                     {spill_up, 0, 1}, {spill_down, 0, -1}};
+            for (const auto &move : moves) {
+                int na = a + move[1], nb = b + move[2];
+                if ((spilled & move[0]) and tiles.holds_cells(na, nb)) {
+                    tiles.push(worker, na * tiles.rows + nb);
+                }
+            }
+            tiles.pending--;
+            count++;
+        }
+        relaxed += count;
+    });
+
+    cover_grains();
+    std::cout << relaxed << " tiles relaxed" << std::endl;
+    return relaxed;
+}
@@ -0,0 +1,201 @@
+#include "warmstart.h"
+#include "profile.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+// The solver works on its own dense octant of width W that just covers the
+// target disc: cell (i, j) with j < W - i lives at start[i] + j.
+struct disc {
+    int width;
+    std::vector<std::size_t> start;
+    std::vector<char> inside;
+    std::vector<double> weight;     // number of plane cells folded onto a cell
+    std::size_t size() const { return start[width]; }
+    std::size_t index(int i, int j) const { return start[i] + j; }
+};
+
+// octant cell of the plane point (x, y), false if it is not in the disc grid
+static inline bool fold(int x, int y, int width, int &i, int &j) {
+    x = std::abs(x);
+    y = std::abs(y);
+    if (x > y) std::swap(x, y);
+    i = y - x;
+    j = x;
+    return y < width;
+}
+
+template <typename F>
+static inline void for_each_neighbour(int i, int j, int width, F f) {
+    const int dx[4] = {1, -1, 0, 0};
+    const int dy[4] = {0, 0, 1, -1};
+    int x = j;
+    int y = i + j;
+    for (int k = 0; k < 4; k++) {
+        int ni, nj;
+        if (fold(x + dx[k], y + dy[k], width, ni, nj)) f(ni, nj);
+    }
+}
+
+// -laplacian(u) on the disc with u = 0 outside it.  Symmetric in the
+// weighted inner product sum(weight * x * y), which is all CG needs.
+static void apply(const disc &d, const std::vector<double> &u,
+                  std::vector<double> &out) {
+    for (int i = 0; i < d.width; i++) {
+        for (int j = 0; j < d.width - i; j++) {
+            std::size_t a = d.index(i, j);
+            if (not d.inside[a]) {
+                out[a] = 0;
+                continue;
+            }
+            double sum = 4 * u[a];
+            for_each_neighbour(i, j, d.width, [&](int ni, int nj) {
+                std::size_t b = d.index(ni, nj);
+                if (d.inside[b]) sum -= u[b];
+            });
+            out[a] = sum;
+        }
+    }
+}
+
+static double dot(const disc &d, const std::vector<double> &x,
+                  const std::vector<double> &y) {
+    double sum = 0;
+    for (std::size_t a = 0; a < d.size(); a++) {
+        sum += d.weight[a] * x[a] * y[a];
+    }
+    return sum;
+}
+
+warm_start_stats warm_start(pile &sandpile, double density, double tolerance) {
+    PROFILE_SCOPE("warm start");
+    assert(density >= 3);
+    warm_start_stats stats = {0, 0, 0};
+    octant &nodes = sandpile.nodes;
+
+    // the reservoir is toppled along with the origin and refilled after
+    double grains = sandpile.reservoir;
+    for (int i = 0; i < nodes.width; i++) {
+        for (int j = 0; j < nodes.length(i); j++) {
+            double multiplicity = (i == 0 and j == 0) ? 1 :
+                                  (i == 0 or j == 0) ? 4 : 8;
+            grains += multiplicity * nodes(i, j);
+        }
+    }
+    double radius = std::sqrt(grains / (M_PI * density));
+
+    disc d;
+    d.width = std::min<int>(std::ceil(radius) + 2, nodes.width - 1);
+    d.start.resize(d.width + 1);
+    d.start[0] = 0;
+    for (int i = 0; i < d.width; i++) {
+        d.start[i+1] = d.start[i] + (d.width - i);
+    }
+    d.inside.resize(d.size());
+    d.weight.resize(d.size());
+    for (int i = 0; i < d.width; i++) {
+        for (int j = 0; j < d.width - i; j++) {
+            double x = j;
+            double y = i + j;
+            std::size_t a = d.index(i, j);
+            // keep a ring of cells outside the disc inside the grid
+            d.inside[a] = x*x + y*y < radius*radius and y < d.width - 1;
+            d.weight[a] = (i == 0 and j == 0) ? 1 : (i == 0 or j == 0) ? 4 : 8;
+        }
+    }
+
+    // conjugate gradients on -laplacian(u) = pile - density, starting from
+    // the continuum solution of a point source in a disc
+    std::vector<double> u(d.size()), f(d.size()), r(d.size()), p(d.size()),
+                        q(d.size());
+    for (int i = 0; i < d.width; i++) {
+        for (int j = 0; j < d.width - i; j++) {
+            std::size_t a = d.index(i, j);
+            if (not d.inside[a]) continue;
+            double x = j;
+            double y = i + j;
+            double rho = std::max(1.0, std::sqrt(x*x + y*y));
+            f[a] = nodes(i, j) - density;
+            if (a == 0) f[a] += sandpile.reservoir;
+            u[a] = grains / (2 * M_PI) * std::log(radius / rho) -
+                   density * (radius*radius - rho*rho) / 4;
+            u[a] = std::max(u[a], 0.0);
+        }
+    }
+    apply(d, u, q);
+    for (std::size_t a = 0; a < d.size(); a++) {
+        r[a] = f[a] - q[a];
+        p[a] = r[a];
+    }
+    double rr = dot(d, r, r);
+    double limit = tolerance * tolerance * dot(d, f, f);
+    int max_iterations = 20 * d.width + 100;
+    while (rr > limit and stats.solver_iterations < max_iterations) {
+        apply(d, p, q);
+        double alpha = rr / dot(d, p, q);
+        for (std::size_t a = 0; a < d.size(); a++) {
+            u[a] += alpha * p[a];
+            r[a] -= alpha * q[a];
+        }
+        double rr_next = dot(d, r, r);
+        double beta = rr_next / rr;
+        rr = rr_next;
+        for (std::size_t a = 0; a < d.size(); a++) {
+            p[a] = r[a] + beta * p[a];
+        }
+        stats.solver_iterations++;
+    }
+    // an unconverged u may overshoot the true odometer, back off a little
+    double scale = rr > limit ? 0.9 : 1.0;
+    if (rr > limit) {
+        std::cout << "warm start solver did not converge in " <<
+                     stats.solver_iterations << " iterations" << std::endl;
+    }
+
+    // topple every cell floor(u) times, then untopple negative cells
+    std::vector<long long> v(d.size()), h(d.size());
+    for (std::size_t a = 0; a < d.size(); a++) {
+        v[a] = d.inside[a] ? std::max(0.0, std::floor(scale * u[a])) : 0;
+    }
+    bool negative = true;
+    while (negative) {
+        negative = false;
+        for (int i = 0; i < d.width; i++) {
+            for (int j = 0; j < d.width - i; j++) {
+                std::size_t a = d.index(i, j);
+                long long height = nodes(i, j) - 4 * v[a];
+                if (a == 0) height += sandpile.reservoir;
+                for_each_neighbour(i, j, d.width, [&](int ni, int nj) {
+                    height += v[d.index(ni, nj)];
+                });
+                h[a] = height;
+            }
+        }
+        for (std::size_t a = 0; a < d.size(); a++) {
+            if (h[a] < 0) {
+                v[a] -= (-h[a] + 3) / 4;
+                negative = true;
+            }
+        }
+        if (negative) stats.repair_rounds++;
+    }
+
+    for (int i = 0; i < d.width; i++) {
+        std::uint64_t *odometer = sandpile.odometer_column(i);
+        int last = 0;
+        for (int j = 0; j < d.width - i; j++) {
+            std::size_t a = d.index(i, j);
+            nodes(i, j) = a == 0 ? 0 : h[a];
+            if (odometer != nullptr) odometer[j] += v[a];
+            stats.topples += v[a];
+            if (h[a] != 0) last = j;
+        }
+        sandpile.j_range[i] = std::max(sandpile.j_range[i],
+                                       std::min(last + 1, nodes.length(i) - 1));
+    }
+    sandpile.reservoir = 0;
+    sandpile.add_grains(h[0]);
+    return stats;
+}
@@ -0,0 +1,27 @@
+#ifndef WARMSTART_H
+#define WARMSTART_H
+
+#include <cstdint>
+#include "pile.h"
+
+// Least action warm start.  The stable pile fills a disc of density a bit
+// above 2, so inside the smaller disc of radius sqrt(grains / (pi density))
+// we solve  laplacian(u) = density - pile  with u = 0 on its rim, by
+// conjugate gradients on the folded octant stencil without ever building a
+// matrix.  For density 3 or more u stays below the true odometer there, so
+// every cell can topple floor(u) times at once.  Cells driven negative by
+// that are untoppled until none is left, and the regular stabilizer
+// finishes the job.  Lower densities can overshoot the odometer and end on
+// another stable pile, and are refused.  If the pile keeps an odometer the
+// warm start topplings are added to it.
+
+struct warm_start_stats {
+    int solver_iterations;
+    int repair_rounds;
+    std::uint64_t topples;    // topplings skipped, counted per octant cell
+};
+
+warm_start_stats warm_start(pile &sandpile, double density = 3.0,
+                            double tolerance = 1e-8);
+
+#endif
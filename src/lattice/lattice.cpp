@@ -0,0 +1,187 @@
+#include "lattice.h"
+#include <algorithm>
+#include <cstdlib>
+
+lattice_pile::lattice_pile(int dimensions, int width) :
+    dimensions(dimensions),
+    width(width) {
+    // ranks reach C(width + d - 2, d), the pull step looks one past that
+    int rows = width + dimensions + 1;
+    binomials.assign((std::size_t)rows * (dimensions + 1), 0);
+    for (int n = 0; n < rows; n++) {
+        binomials[(std::size_t)n * (dimensions + 1)] = 1;
+        for (int r = 1; r <= std::min(n, dimensions); r++) {
+            binomials[(std::size_t)n * (dimensions + 1) + r] =
+                binomial(n - 1, r - 1) + (r < n ? binomial(n - 1, r) : 0);
+        }
+    }
+    heights.assign(cube(width), 0);
+    topples.assign(heights.size(), 0);
+}
+
+std::size_t lattice_pile::rank(const int *x) const {
+    std::size_t r = 0;
+    for (int k = 0; k < dimensions; k++) {
+        r += binomial(x[k] + dimensions - 1 - k, dimensions - k);
+    }
+    return r;
+}
+
+void lattice_pile::point(std::size_t rank, int *x) const {
+    for (int k = 0; k < dimensions; k++) {
+        // largest c with C(c, d - k) <= rank
+        int lo = dimensions - 1 - k, hi = width + dimensions - 1 - k;
+        while (hi - lo > 1) {
+            int mid = (lo + hi) / 2;
+            if (binomial(mid, dimensions - k) <= rank) lo = mid;
+            else hi = mid;
+        }
+        rank -= binomial(lo, dimensions - k);
+        x[k] = lo - (dimensions - 1 - k);
+    }
+}
+
+std::uint64_t lattice_pile::multiplicity(const int *x) const {
+    // 2^(nonzero coordinates) sign flips times the distinct orderings
+    std::uint64_t m = 1;
+    int run = 0;
+    for (int k = 0; k < dimensions; k++) {
+        if (x[k] != 0) m *= 2;
+        run = (k > 0 and x[k] == x[k-1]) ? run + 1 : 1;
+        m = m * (k + 1) / run;
+    }
+    return m;
+}
+
+lattice_cell *lattice_pile::find(const int *x) {
+    // mirror into the positive cone, then sort descending
+    int y[max_dimensions] = {};
+    for (int k = 0; k < dimensions; k++) {
+        int v = std::abs(x[k]), m = k;
+        for (; m > 0 and y[m-1] < v; m--) y[m] = y[m-1];
+        y[m] = v;
+    }
+    if (y[0] >= width) return nullptr;
+    return &heights[rank(y)];
+}
+
+std::uint64_t lattice_pile::grains() const {
+    std::uint64_t total = 0;
+    int x[max_dimensions] = {0};
+    std::size_t end = cube(width - 1);
+    for (std::size_t r = 0; r < end; r++) {
+        if (heights[r] != 0) {
+            point(r, x);
+            total += multiplicity(x) * heights[r];
+        }
+    }
+    return total;
+}
+
+// Pulls into each point of ranks [lo, hi) what its neighbours toppled.  x
+// walks the domain in rank order alongside r.  A neighbour x +- e_k folds
+// back by raising the first or lowering the last coordinate of the run of
+// values equal to x[k]; -e_k off a zero reflects onto +e_k.  Returns
+// whether any point of rank >= grown received grains.
+template <int D>
+static bool pull(lattice_pile &p, std::size_t lo, std::size_t hi,
+                 std::size_t grown) {
+    const lattice_cell *topples = p.topples.data();
+    lattice_cell *heights = p.heights.data();
+    int x[D];
+    p.point(lo, x);
+    bool grew = false;
+    for (std::size_t r = lo; r < hi; r++) {
+        lattice_cell in = 0;
+        for (int first = 0; first < D;) {
+            int last = first;
+            while (last + 1 < D and x[last+1] == x[first]) last++;
+            int run = last - first + 1;
+            int c = x[first] + D - 1 - first;
+            lattice_cell up = 0;
+            if (first > 0 or x[0] + 1 < p.width) {
+                up = topples[r - p.binomial(c, D - first) + p.binomial(c + 1, D - first)];
+            }
+            in += run * up;
+            if (x[first] == 0) {
+                in += run * up;
+            } else {
+                int cl = x[last] + D - 1 - last;
+                in += run * topples[r - p.binomial(cl, D - last) +
+                                    p.binomial(cl - 1, D - last)];
+            }
+            first = last + 1;
+        }
+        if (in != 0) {
+            heights[r] += in;
+            grew |= r >= grown;
+        }
+        // next point in rank order
+        int k = D - 1;
+        while (k > 0 and x[k] == x[k-1]) x[k--] = 0;
+        x[k]++;
+    }
+    return grew;
+}
+
+template <int D>
+static int stabilize_wedge(lattice_pile &p, ThreadPool &pool) {
+    const lattice_cell degree = 2 * D;
+    int workers = pool.size();
+    // points with x[0] > reach hold nothing
+    int reach = 0;
+    for (std::size_t r = p.size(); r-- > 0;) {
+        if (p.heights[r] != 0) {
+            int x[D];
+            p.point(r, x);
+            reach = x[0];
+            break;
+        }
+    }
+    std::vector<char> toppled(workers), grew(workers);
+    int count = 0;
+    while (true) {
+        count++;
+        // the sink shell never topples
+        std::size_t topple_end = p.cube(std::min(reach + 1, p.width - 1));
+        std::size_t pull_end = p.cube(std::min(reach + 2, p.width));
+        std::size_t grown = p.cube(reach + 1);
+        pool.run([&](int b) {
+            std::size_t lo = topple_end * b / workers;
+            std::size_t hi = topple_end * (b + 1) / workers;
+            bool any = false;
+            for (std::size_t r = lo; r < hi; r++) {
+                lattice_cell t = p.heights[r] / degree;
+                p.topples[r] = t;
+                p.heights[r] -= t * degree;
+                any |= t != 0;
+            }
+            toppled[b] = any;
+        });
+        if (std::find(toppled.begin(), toppled.end(), 1) == toppled.end()) break;
+        pool.run([&](int b) {
+            std::size_t lo = pull_end * b / workers;
+            std::size_t hi = pull_end * (b + 1) / workers;
+            grew[b] = lo < hi and pull<D>(p, lo, hi, grown);
+        });
+        if (std::find(grew.begin(), grew.end(), 1) != grew.end()) {
+            reach = std::min(reach + 1, p.width - 1);
+        }
+    }
+    std::fill(p.topples.begin(), p.topples.end(), 0);
+    p.sweeps += count;
+    return count;
+}
+
+int lattice_pile::stabilize(ThreadPool &pool) {
+    switch (dimensions) {
+    case 1: return stabilize_wedge<1>(*this, pool);
+    case 2: return stabilize_wedge<2>(*this, pool);
+    case 3: return stabilize_wedge<3>(*this, pool);
+    case 4: return stabilize_wedge<4>(*this, pool);
+    case 5: return stabilize_wedge<5>(*this, pool);
+    case 6: return stabilize_wedge<6>(*this, pool);
+    case 7: return stabilize_wedge<7>(*this, pool);
+    default: return stabilize_wedge<8>(*this, pool);
+    }
+}
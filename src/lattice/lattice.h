@@ -0,0 +1,54 @@
+#ifndef LATTICE_H
+#define LATTICE_H
+
+#include <cstdint>
+#include <vector>
+#include "../grid/pool.h"
+
+// Sandpile on the d dimensional cubic lattice, a site toppling one grain to
+// each of its 2d axis neighbours, kept only on the fundamental domain of
+// the hyperoctahedral group: the points
+//     width > x[0] >= x[1] >= ... >= x[d-1] >= 0,
+// one per orbit of axis mirrors and permutations (a 1/48 wedge in 3D).  The
+// shell x[0] == width - 1 is the sink, so in the plane this is the octant
+// of src/grid with (x[0], x[1]) = (i + j, j).
+//
+// Points are stored by their rank in the combinatorial number system,
+//     rank(x) = sum_k C(x[k] + d - 1 - k, d - k),
+// which runs through them with x[0] slowest, so every cube around the
+// origin is a prefix of the array.  No stencil is stored: a point's
+// neighbours are folded back into the domain as they are visited, and
+// raising or lowering one coordinate changes a single term of the rank.
+typedef std::uint32_t lattice_cell;
+
+struct lattice_pile {
+    static const int max_dimensions = 8;
+    int dimensions;
+    int width;
+    std::vector<lattice_cell> heights;
+    std::vector<lattice_cell> topples;      // per sweep, scratch
+    std::vector<std::uint64_t> binomials;   // C(n, r) at n * (dimensions + 1) + r
+    std::uint64_t sweeps = 0;
+    // 1 <= dimensions <= max_dimensions, width >= 2
+    lattice_pile(int dimensions, int width);
+    std::uint64_t binomial(int n, int r) const {
+        return binomials[(std::size_t)n * (dimensions + 1) + r];
+    }
+    // points with x[0] < m
+    std::size_t cube(int m) const { return binomial(m + dimensions - 1, dimensions); }
+    std::size_t size() const { return heights.size(); }
+    std::size_t rank(const int *x) const;
+    void point(std::size_t rank, int *x) const;
+    // lattice points folded onto the domain point x
+    std::uint64_t multiplicity(const int *x) const;
+    // the cell any lattice point folds onto, nullptr outside the domain
+    lattice_cell *find(const int *x);
+    // grains on the pile, the sink not counted
+    std::uint64_t grains() const;
+    // Jacobi sweeps over the pool, each worker taking a share of the
+    // ranks: every unstable point topples all it can, then every point
+    // pulls in what its neighbours toppled.  Returns the sweeps taken.
+    int stabilize(ThreadPool &pool);
+};
+
+#endif
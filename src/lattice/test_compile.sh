@@ -0,0 +1 @@
+g++ -O2 -std=c++17 -pthread test_lattice.cpp lattice.cpp ../grid/pile.cpp ../grid/octant.cpp ../grid/kernel.cpp ../grid/pool.cpp ../grid/telemetry.cpp ../grid/snapshot.cpp ../grid/frames.cpp ../grid/render.cpp ../grid/profile.cpp ../grid/sliced.cpp -o test_lattice
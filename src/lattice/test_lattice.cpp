@@ -0,0 +1,137 @@
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "lattice.h"
+#include "../grid/pile.h"
+
+static int failures = 0;
+
+static void check(bool ok, const std::string &what)
+{
+    std::cout << (ok ? "ok   " : "FAIL ") << what << std::endl;
+    if (not ok) failures++;
+}
+
+static void test_ranks()
+{
+    for (int d = 1; d <= 5; d++) {
+        lattice_pile p(d, 9);
+        std::vector<int> x(d, 0), y(d);
+        std::uint64_t points = 0;
+        bool ok = true;
+        for (std::size_t r = 0; r < p.size(); r++) {
+            p.point(r, y.data());
+            ok &= y == x and p.rank(y.data()) == r;
+            points += p.multiplicity(y.data());
+            int k = d - 1;
+            while (k > 0 and x[k] == x[k-1]) x[k--] = 0;
+            x[k]++;
+        }
+        std::uint64_t cube = 1;
+        for (int k = 0; k < d; k++) cube *= 2 * 9 - 1;
+        check(ok, std::to_string(d) + "D ranks run through the domain in order");
+        check(points == cube, std::to_string(d) + "D orbits cover the cube");
+    }
+}
+
+// 2D wedge point (x[0], x[1]) is octant cell (x[0] - x[1], x[1])
+static void test_plane_matches_grid()
+{
+    const int width = 120;
+    pile reference(width);
+    reference.nodes(0, 0) = 20000;
+    reference.stabilize();
+    for (int threads: {1, 3}) {
+        ThreadPool pool(threads);
+        lattice_pile p(2, width);
+        p.heights[0] = 20000;
+        p.stabilize(pool);
+        bool ok = true;
+        for (int a = 0; a < width - 1; a++) {
+            for (int b = 0; b <= a; b++) {
+                int x[2] = {a, b};
+                ok &= *p.find(x) == reference.nodes(a - b, b);
+            }
+        }
+        check(ok, "2D lattice pile on " + std::to_string(threads) +
+                  " threads matches grid pile");
+    }
+}
+
+// plain sandpile on the whole cube, the box surface being the sink
+static std::vector<long> full_cube(int d, int width, long grains)
+{
+    int side = 2 * width - 1;
+    std::size_t n = 1;
+    for (int k = 0; k < d; k++) n *= side;
+    std::vector<long> h(n, 0);
+    std::size_t origin = 0;
+    for (int k = 0; k < d; k++) origin = origin * side + width - 1;
+    h[origin] = grains;
+    bool done = false;
+    while (not done) {
+        done = true;
+        for (std::size_t c = 0; c < n; c++) {
+            bool boundary = false;
+            std::size_t stride = 1;
+            for (int k = 0; k < d; k++) {
+                int coordinate = c / stride % side;
+                boundary |= coordinate == 0 or coordinate == side - 1;
+                stride *= side;
+            }
+            if (boundary or h[c] < 2 * d) continue;
+            long t = h[c] / (2 * d);
+            h[c] -= 2 * d * t;
+            stride = 1;
+            for (int k = 0; k < d; k++) {
+                h[c + stride] += t;
+                h[c - stride] += t;
+                stride *= side;
+            }
+            done = false;
+        }
+    }
+    return h;
+}
+
+static void test_cube_unfolds()
+{
+    for (int d: {3, 4}) {
+        const int width = d == 3 ? 9 : 6;
+        const long grains = d == 3 ? 3000 : 5000;
+        std::vector<long> reference = full_cube(d, width, grains);
+        ThreadPool pool(2);
+        lattice_pile p(d, width);
+        p.heights[0] = grains;
+        p.stabilize(pool);
+        int side = 2 * width - 1;
+        bool ok = true;
+        long lost = grains;
+        for (std::size_t c = 0; c < reference.size(); c++) {
+            std::vector<int> x(d);
+            std::size_t stride = 1;
+            bool boundary = false;
+            for (int k = 0; k < d; k++) {
+                x[k] = int(c / stride % side) - (width - 1);
+                boundary |= std::abs(x[k]) == width - 1;
+                stride *= side;
+            }
+            if (boundary) continue;
+            ok &= *p.find(x.data()) == reference[c];
+            lost -= reference[c];
+        }
+        check(ok, std::to_string(d) + "D lattice pile unfolds to the cube pile");
+        check(p.grains() == std::uint64_t(grains - lost),
+              std::to_string(d) + "D grains are accounted for");
+    }
+}
+
+int main()
+{
+    test_ranks();
+    test_plane_matches_grid();
+    test_cube_unfolds();
+    std::cout << failures << " failures" << std::endl;
+    return failures != 0;
+}
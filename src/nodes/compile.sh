@@ -0,0 +1,3 @@
+g++ -O2 -std=c++17 -pthread sandpile.cpp pile.cpp ../grid/render.cpp ../grid/pool.cpp
+# with the SDL viewer:
+# g++ -O2 -std=c++17 -pthread -DUSE_SDL sandpile.cpp pile.cpp ../grid/render.cpp ../grid/pool.cpp -lSDL2
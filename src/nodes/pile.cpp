@@ -1,131 +1,288 @@
 #include "pile.h"
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <new>
 
-long link::spill(long spillover) {
-  return linkToNode->height += spillover * linkWeight;
-}
+graphBuilder::graphBuilder(int numNodes, long defaultLimit)
+  : numNodes(numNodes), defaultLimit(defaultLimit) { }
 
-link::link(node* nodePtr, int weight) {
-  linkToNode = nodePtr;
-  linkWeight =  weight;
+int graphBuilder::addNodes(int count) {
+  numNodes += count;
+  return numNodes - count;
 }
 
-bool node::spill() {
-  if (height < heightLimit) return false;
-  int spillover = height / heightLimit;
-  height = height % heightLimit;
-  for (auto &x : links) x.spill(spillover);
-  return true;
+void graphBuilder::link(int from, int to, int weight) {
+  links.push_back({from, to, weight});
 }
 
-bool node::spillChain() {
-  if (height < heightLimit) return false;
-  node* nodePtr = this;
-  int spillover;
-  do {
-    spillover = nodePtr->height / nodePtr->heightLimit;
-    nodePtr->height = nodePtr->height % nodePtr->heightLimit;
-    for (auto &x : nodePtr->links) {
-      if (x.spill(spillover) > nodePtr->height) nodePtr = x.linkToNode;
-    }
-  } while (nodePtr->height >= nodePtr->heightLimit);
-  return true;
+void graphBuilder::heightLimit(int node, long limit) {
+  limits.push_back({node, limit});
 }
 
-void pile::makeLink(int inode1, int jnode1, int inode2, int jnode2, int linkWeight) {
-  nodes[inode1][jnode1]->links.push_back(link(nodes[inode2][jnode2],linkWeight));
+// bytes rounded up to whole cache lines, so every array starts on one
+static std::size_t lines(std::size_t bytes) {
+  return (bytes + 63) / 64 * 64;
 }
 
-pile::pile(int N) {
-  nodes.resize(N);
-  for (int i = 0; i < nodes.size(); i++) {
-    nodes[i].resize(i+1);
-    for (int j = 0; j < nodes[i].size(); j++) {
-      nodes[i][j] = new node;
-    }
+sandGraph::sandGraph(const graphBuilder &builder)
+  : numNodes(builder.numNodes), defaultLimit(builder.defaultLimit) {
+  int numLinks = builder.links.size();
+  std::size_t heightBytes = lines(numNodes * sizeof(long));
+  std::size_t startBytes = lines((numNodes + 1) * sizeof(int));
+  std::size_t linkBytes = lines(numLinks * sizeof(int));
+  std::size_t total = heightBytes + startBytes + 2 * linkBytes;
+  arena = static_cast<char*>(std::aligned_alloc(64, std::max<std::size_t>(total, 64)));
+  if (arena == nullptr) throw std::bad_alloc();
+  heights = reinterpret_cast<long*>(arena);
+  rowStart = reinterpret_cast<int*>(arena + heightBytes);
+  targets = reinterpret_cast<int*>(arena + heightBytes + startBytes);
+  weights = reinterpret_cast<int*>(arena + heightBytes + startBytes + linkBytes);
+  std::fill(heights, heights + numNodes, 0L);
+
+  // counting sort of the links by source, keeping each node's own order
+  std::fill(rowStart, rowStart + numNodes + 1, 0);
+  for (auto &x : builder.links) rowStart[x.from + 1]++;
+  for (int k = 0; k < numNodes; k++) rowStart[k + 1] += rowStart[k];
+  std::vector<int> next(rowStart, rowStart + numNodes);
+  for (auto &x : builder.links) {
+    int e = next[x.from]++;
+    targets[e] = x.to;
+    weights[e] = x.weight;
   }
 
-  // right links
-  for (int i = 0; i < N - 1; i++) {
-    for (int j = 0; j <= i; j++) {
-      makeLink(i, j, i + 1, j, 1);
-    }
+  // the last limit given for a node wins, and only exceptions are kept
+  std::map<int, long> latest;
+  for (auto &x : builder.limits) latest[x.first] = x.second;
+  for (auto &x : latest) {
+    if (x.second != defaultLimit) limits.push_back(x);
   }
+}
 
-  // left links
-  for (int i = 1; i < N - 1; i++) {
-    for (int j = 0; j < i; j++) {
-      if (i == 1 & j == 0) {
-        makeLink(i, j, i - 1, j, 4);
-      } else if (j == i - 1) {
-        makeLink(i, j, i - 1, j, 2);
-      } else {
-        makeLink(i, j, i - 1, j, 1);
+sandGraph::~sandGraph() {
+  std::free(arena);
+}
+
+long sandGraph::heightLimit(int k) const {
+  if (limits.empty()) return defaultLimit;
+  auto it = std::lower_bound(limits.begin(), limits.end(), std::make_pair(k, 0L),
+                             [](const std::pair<int, long> &a,
+                                const std::pair<int, long> &b) {
+                               return a.first < b.first;
+                             });
+  return (it != limits.end() && it->first == k) ? it->second : defaultLimit;
+}
+
+// The sweeps are written once against a limit functor, so the common case of
+// one limit everywhere, and 4 in particular, compiles to plain arithmetic.
+template <typename Limit>
+static int sweepSpill(int n, long *height, const int *start, const int *target,
+                      const int *weight, Limit limit) {
+  bool done = false;
+  int sweeps = 0;
+  while (!done) {
+    done = true;
+    sweeps++;
+    for (int k = 0; k < n; k++) {
+      long heightLimit = limit(k);
+      if (height[k] < heightLimit) continue;
+      done = false;
+      long spillover = height[k] / heightLimit;
+      height[k] %= heightLimit;
+      for (int e = start[k]; e < start[k + 1]; e++) {
+        height[target[e]] += spillover * weight[e];
       }
     }
   }
+  return sweeps;
+}
 
-  // up links
-  for (int i = 1; i < N - 1; i++) {
-    for (int j = 0; j < i; j++) {
-      if (j == i - 1) {
-        makeLink(i, j, i, j + 1, 2);
-      } else {
-        makeLink(i, j, i, j + 1, 1);
-      }
+// Chaining: after a node spills, carry on from the neighbour that ended up
+// tallest, rather than waiting for the sweep to come round to it.
+template <typename Limit>
+static int sweepChain(int n, long *height, const int *start, const int *target,
+                      const int *weight, Limit limit) {
+  bool done = false;
+  int sweeps = 0;
+  while (!done) {
+    done = true;
+    sweeps++;
+    for (int k = 0; k < n; k++) {
+      long heightLimit = limit(k);
+      if (height[k] < heightLimit) continue;
+      done = false;
+      int current = k;
+      do {
+        long spillover = height[current] / heightLimit;
+        height[current] %= heightLimit;
+        int next = current;
+        for (int e = start[current]; e < start[current + 1]; e++) {
+          if ((height[target[e]] += spillover * weight[e]) > height[next]) {
+            next = target[e];
+          }
+        }
+        current = next;
+        heightLimit = limit(current);
+      } while (height[current] >= heightLimit);
     }
   }
+  return sweeps;
+}
 
-  // down links
-  for (int i = 1; i < N - 1; i++) {
-    for (int j = 1; j <= i; j++) {
-      if (j == 1) {
-        makeLink(i, j, i, j - 1, 2);
-      } else {
-        makeLink(i, j, i, j - 1, 1);
-      }
-    }
+int sandGraph::stabilize() {
+  if (!limits.empty()) {
+    return sweepSpill(numNodes, heights, rowStart, targets, weights,
+                      [this](int k) { return heightLimit(k); });
   }
+  if (defaultLimit == 4) {
+    return sweepSpill(numNodes, heights, rowStart, targets, weights,
+                      [](int) { return 4L; });
+  }
+  long uniform = defaultLimit;
+  return sweepSpill(numNodes, heights, rowStart, targets, weights,
+                    [uniform](int) { return uniform; });
+}
 
+int sandGraph::stabilizeWithChaining() {
+  if (!limits.empty()) {
+    return sweepChain(numNodes, heights, rowStart, targets, weights,
+                      [this](int k) { return heightLimit(k); });
+  }
+  if (defaultLimit == 4) {
+    return sweepChain(numNodes, heights, rowStart, targets, weights,
+                      [](int) { return 4L; });
+  }
+  long uniform = defaultLimit;
+  return sweepChain(numNodes, heights, rowStart, targets, weights,
+                    [uniform](int) { return uniform; });
 }
 
-pile::~pile() {
-  for (int i = 0; i < nodes.size(); i++) {
-    for (int j = 0; j < nodes[i].size(); j++) {
-      delete nodes[i][j];
+graphBuilder pile::lattice(int N) {
+  graphBuilder builder(N * (N + 1) / 2);
+  builder.links.reserve(4 * builder.numNodes);
+
+  // per node: right, left, up, down
+  for (int i = 0; i < N - 1; i++) {
+    for (int j = 0; j <= i; j++) {
+      int k = index(i, j);
+      builder.link(k, index(i + 1, j), 1);
+      if (i == 0) continue;
+      if (j < i) {
+        builder.link(k, index(i - 1, j), (i == 1 && j == 0) ? 4 : (j == i - 1) ? 2 : 1);
+        builder.link(k, index(i, j + 1), (j == i - 1) ? 2 : 1);
+      }
+      if (j >= 1) builder.link(k, index(i, j - 1), (j == 1) ? 2 : 1);
     }
   }
+  return builder;
 }
 
-void pile::stabilize() {
-  bool done = false;
-  while (!done) {
-    done = true;
-    for (auto &nodeVector : nodes) {
-      for (auto &nodePtr : nodeVector) {
-        done &= !nodePtr->spill();
+pile::pile(int N) : N(N), nodes(lattice(N)) { }
+
+// Least action warm start, see src/grid/warmstart.h: solve
+// laplacian(u) = density - height on the disc the pile will roughly fill at
+// that density, topple every node floor(u) times in one pass and untopple
+// nodes that went negative.  Density must be at least 3, below that u can
+// overshoot the odometer.  The laplacian is applied through the links, so
+// nothing but the node layout (x, y) = (i, j) is assumed.  Returns the
+// number of topplings skipped.
+long pile::warmStart(double density, double tolerance) {
+  assert(density >= 3);
+  int n = nodes.size();
+  std::vector<double> weight;
+  std::vector<bool> inside;
+  double grains = 0;
+  for (int i = 0; i < N; i++) {
+    for (int j = 0; j <= i; j++) {
+      double multiplicity = (i == 0) ? 1 : (j == 0 || j == i) ? 4 : 8;
+      weight.push_back(multiplicity);
+      grains += multiplicity * height(i, j);
+    }
+  }
+  double radius = std::sqrt(grains / (M_PI * density));
+  for (int i = 0; i < N; i++) {
+    for (int j = 0; j <= i; j++) {
+      inside.push_back(i*i + j*j < radius*radius && i < N - 2);
+    }
+  }
+
+  // -laplacian restricted to the disc, symmetric in the weighted product
+  auto apply = [&](const std::vector<double> &u, std::vector<double> &out) {
+    std::fill(out.begin(), out.end(), 0.0);
+    for (int k = 0; k < n; k++) {
+      if (!inside[k] || u[k] == 0) continue;
+      out[k] += nodes.heightLimit(k) * u[k];
+      for (int e = nodes.first(k); e < nodes.first(k + 1); e++) {
+        out[nodes.target(e)] -= nodes.weight(e) * u[k];
       }
     }
+    for (int k = 0; k < n; k++) {
+      if (!inside[k]) out[k] = 0;
+    }
+  };
+  auto dot = [&](const std::vector<double> &x, const std::vector<double> &y) {
+    double sum = 0;
+    for (int k = 0; k < n; k++) sum += weight[k] * x[k] * y[k];
+    return sum;
+  };
+
+  std::vector<double> u(n), f(n), r(n), p(n), q(n);
+  for (int k = 0; k < n; k++) {
+    if (inside[k]) f[k] = nodes.height(k) - density;
   }
-}
+  r = f;
+  p = r;
+  double rr = dot(r, r);
+  double limit = tolerance * tolerance * rr;
+  int iterations = 0;
+  while (rr > limit && iterations < 20 * N + 100) {
+    apply(p, q);
+    double alpha = rr / dot(p, q);
+    for (int k = 0; k < n; k++) {
+      u[k] += alpha * p[k];
+      r[k] -= alpha * q[k];
+    }
+    double rrNext = dot(r, r);
+    for (int k = 0; k < n; k++) p[k] = r[k] + rrNext / rr * p[k];
+    rr = rrNext;
+    iterations++;
+  }
+  double scale = rr > limit ? 0.9 : 1.0;
 
-void pile::stabilizeWithChaining() {
-  bool done = false;
-  int spillover;
-  while (!done) {
-    done = true;
-    for (auto &nodeVector : nodes) {
-      for (auto nodePtr : nodeVector) {
-        if (nodePtr->height >= nodePtr->heightLimit) {
-          done = false;
-          do {
-            spillover = nodePtr->height / nodePtr->heightLimit;
-            nodePtr->height = nodePtr->height % nodePtr->heightLimit;
-            for (auto &link : nodePtr->links) {
-              if (link.spill(spillover) > nodePtr->height) nodePtr = link.linkToNode;
-            }
-          } while (nodePtr->height >= nodePtr->heightLimit);
-        }
+  std::vector<long> v(n), h(n);
+  for (int k = 0; k < n; k++) {
+    v[k] = inside[k] ? std::max(0.0, std::floor(scale * u[k])) : 0;
+  }
+  int rounds = 0;
+  bool negative = true;
+  while (negative) {
+    negative = false;
+    for (int k = 0; k < n; k++) h[k] = nodes.height(k);
+    for (int k = 0; k < n; k++) {
+      if (v[k] == 0) continue;
+      h[k] -= nodes.heightLimit(k) * v[k];
+      for (int e = nodes.first(k); e < nodes.first(k + 1); e++) {
+        h[nodes.target(e)] += nodes.weight(e) * v[k];
       }
     }
+    for (int k = 0; k < n; k++) {
+      if (h[k] < 0) {
+        long limit = nodes.heightLimit(k);
+        v[k] -= (-h[k] + limit - 1) / limit;
+        negative = true;
+      }
+    }
+    rounds += negative;
+  }
+
+  long topples = 0;
+  for (int k = 0; k < n; k++) {
+    nodes.height(k) = h[k];
+    topples += v[k];
   }
+  std::cout << "warm start: " << iterations << " solver iterations, " <<
+    rounds << " repair rounds, " << topples << " topplings skipped" << std::endl;
+  return topples;
 }
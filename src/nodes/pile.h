@@ -2,35 +2,76 @@
 #define DANCINGLINKS_H
 
 #include <vector>
-#include <set>
 #include <cmath>
+#include <utility>
 
+// Collects the nodes and links of a sandpile graph.  Links are kept in the
+// order they were added, per node, and that is the order a toppling node
+// hands out its grains in.
+struct graphBuilder {
+  struct linkSpec {
+    int from;
+    int to;
+    int weight;
+  };
+  int numNodes = 0;
+  long defaultLimit = 4;
+  std::vector<linkSpec> links;
+  std::vector<std::pair<int, long>> limits;   // only the non default ones
 
-struct node;
-struct pile;
-
-struct link {
-  node* linkToNode;
-  long linkWeight;
-  link(node* nodePtr, int linkWeight);
-  long spill(long spillover);
+  explicit graphBuilder(int numNodes = 0, long defaultLimit = 4);
+  int addNodes(int count);                    // first index of the new nodes
+  void link(int from, int to, int weight);
+  void heightLimit(int node, long limit);
 };
 
-struct node {
-  long height = 0;
-  long heightLimit = 4;
-  std::vector<link> links;
-  bool spill();
-  bool spillChain();
+// A sandpile on an arbitrary graph, laid out as arrays: heights, then the
+// links of every node in compressed sparse rows, all carved out of one
+// allocation.  A node topples when its height reaches its limit, giving
+// weight grains per toppling to each link's target.  Nodes without links are
+// sinks.
+class sandGraph {
+ public:
+  explicit sandGraph(const graphBuilder &builder);
+  ~sandGraph();
+  sandGraph(const sandGraph &) = delete;
+  sandGraph &operator=(const sandGraph &) = delete;
+
+  int size() const { return numNodes; }
+  long &height(int k) { return heights[k]; }
+  long height(int k) const { return heights[k]; }
+  long heightLimit(int k) const;
+  // links of node k are first(k) <= e < first(k + 1)
+  int first(int k) const { return rowStart[k]; }
+  int target(int e) const { return targets[e]; }
+  int weight(int e) const { return weights[e]; }
+
+  int stabilize();
+  int stabilizeWithChaining();
+
+ private:
+  int numNodes;
+  long defaultLimit;
+  std::vector<std::pair<int, long>> limits;   // sorted by node
+  char *arena;
+  long *heights;
+  int *rowStart;
+  int *targets;
+  int *weights;
 };
 
+// The symmetric square lattice folded to an eighth: node (i, j), j <= i, is
+// the point (i, j) of the plane and row N - 1 is the sink.
 struct pile {
-  std::vector<std::vector<node*>> nodes;
+  int N;
+  sandGraph nodes;
   pile(int N);
-  ~pile();
-  void makeLink(int inode1, int jnode1, int inode2, int jnode2, int linkWeight);
-  void stabilizeWithChaining();
-  void stabilize();
+  static graphBuilder lattice(int N);
+  static int index(int i, int j) { return i * (i + 1) / 2 + j; }
+  long &height(int i, int j) { return nodes.height(index(i, j)); }
+  int stabilizeWithChaining() { return nodes.stabilizeWithChaining(); }
+  int stabilize() { return nodes.stabilize(); }
+  long warmStart(double density = 3.0, double tolerance = 1e-8);
 };
 
 #endif
@@ -1,15 +1,21 @@
 //#include <emscripten.h>
+#ifdef USE_SDL
 #include <SDL2/SDL.h>
+#endif
 #include "pile.h"
+#include "../grid/render.h"
 
 #include <iostream>
+#include <algorithm>
 #include <chrono>
+#include <cstdlib>
+#include <string>
 
 
 void printPile(pile &sandpile) {
-  for (int i = 0; i < sandpile.nodes.size(); i++) {
+  for (int i = 0; i < sandpile.N; i++) {
     for (int j = 0; j <= i; j++) {
-      std::cout << sandpile.nodes[i][j]->height;
+      std::cout << sandpile.height(i, j);
     }
     std::cout << std::endl;
   }
@@ -17,6 +23,18 @@ void printPile(pile &sandpile) {
 }
 
 
+// plane rows for the renderer: node (i, j) is the point (i, j), j <= i
+row_source nodeRows(pile &sandpile) {
+  return [&sandpile](int ay, unsigned char *row) {
+    for (int ax = 0; ax < sandpile.N; ax++) {
+      long height = ax >= ay ? sandpile.height(ax, ay)
+                             : sandpile.height(ay, ax);
+      row[ax] = std::min(height, 255L);
+    }
+  };
+}
+
+#ifdef USE_SDL
 static void sdlError(const char *str)
 {
   std::cout <<  "Error at " << str << ": " << SDL_GetError() << std::endl;
@@ -24,82 +42,73 @@ static void sdlError(const char *str)
   //  emscripten_force_exit(1);
 }
 
-void draw(pile &sandpile, int N) {
+// shows the rendered pile until the window is closed
+void view(std::vector<std::uint32_t> &pixels, int side) {
 
   SDL_Window *window;
   SDL_Surface *surface;
+  SDL_Surface *image;
 
   if (SDL_Init(SDL_INIT_VIDEO) != 0) sdlError("SDL_Init");
 
   window = SDL_CreateWindow("Sand Piles",
                             SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
-                            2 * N - 1, 2 * N - 1,
+                            side, side,
                             SDL_WINDOW_SHOWN);
   if (window == NULL) sdlError("SDL_CreateWindow");
   surface = SDL_GetWindowSurface(window);
   if (surface == NULL) sdlError("SDL_GetWindowSurface");
+  image = SDL_CreateRGBSurfaceWithFormatFrom(pixels.data(), side, side, 32,
+                                             side * sizeof(std::uint32_t),
+                                             SDL_PIXELFORMAT_ARGB8888);
+  if (image == NULL) sdlError("SDL_CreateRGBSurfaceWithFormatFrom");
 
-  int x, y, z;
-
-  if (SDL_MUSTLOCK(surface)) {
-      if (SDL_LockSurface(surface) != 0) sdlError("SDL_LockSurface");
-  }
-
-  for (y = -N + 1; y < N; y++) {
-      Uint32 *p = (Uint32 *)(((Uint8 *)surface->pixels) +
-                             surface->pitch * (y+N-1));
-      for (x = -N + 1; x < N; x++) {
-        if (abs(x) <= abs(y)) {
-          z = sandpile.nodes[abs(y)][abs(x)]->height;
-        } else {
-          z = sandpile.nodes[abs(x)][abs(y)]->height;
-        }
-
-        switch(z) {
-          case 0:
-            *(p++) = SDL_MapRGB(surface->format, 255, 255, 255);
-            break;
-          case 1:
-            *(p++) = SDL_MapRGB(surface->format, 0, 150, 230);
-            break;
-          case 2:
-            *(p++) = SDL_MapRGB(surface->format, 250, 200, 0);
-            break;
-          case 3:
-            *(p++) = SDL_MapRGB(surface->format, 178, 40, 100);
-            break;
-          default:
-            std::cout << "missed values " << z << " at x: " << x << " and y: " << y << std::endl;
-        }
-      }
-  }
-
-  if (SDL_MUSTLOCK(surface)) SDL_UnlockSurface(surface);
+  if (SDL_BlitSurface(image, NULL, surface, NULL) != 0) sdlError("SDL_BlitSurface");
   if (SDL_UpdateWindowSurface(window) != 0)
       sdlError("SDL_UpdateWindowSurface");
 
+  SDL_Event event;
+  while (SDL_WaitEvent(&event) && event.type != SDL_QUIT) { }
 
-  SDL_SaveBMP(surface, "out.bmp");
-  //Wait two seconds
-  SDL_Delay( 2000 );
-
+  SDL_FreeSurface(image);
   //Destroy window
   SDL_DestroyWindow( window );
   //Quit SDL subsystems
   SDL_Quit();
 }
+#endif
+
 
+static void usage(const char *program) {
+  std::cout << "usage: " << program << " [options]\n"
+            << "  --warm-start D   pre-topple to density D, at least 3, 0: off (default 0)\n";
+}
 
-int main(void) {
+int main(int argc, char **argv) {
 
   using namespace std::chrono;
 
+  double warmStart = 0;
+  for (int k = 1; k < argc; k += 2) {
+    std::string name = argv[k];
+    char *end = nullptr;
+    if (name == "--warm-start" && k + 1 < argc) {
+      warmStart = std::strtod(argv[k+1], &end);
+    }
+    // below 3 the warm start can overshoot the odometer
+    if (end == nullptr || *end != '\0' || (warmStart != 0 && warmStart < 3)) {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
   high_resolution_clock::time_point t1 = high_resolution_clock::now();
 
   int width = 150;
   long numGrains = pow(2,17);
   pile sandpile(width);
-  sandpile.nodes[0][0]->height = numGrains;
+  sandpile.height(0, 0) = numGrains;
+  if (warmStart > 0) sandpile.warmStart(warmStart);
 
   high_resolution_clock::time_point t2 = high_resolution_clock::now();
   duration<double> time_span = duration_cast<duration<double>>(t2 - t1);
@@ -107,7 +116,7 @@ int main(void) {
   std::cout << "initialization done.  Time elapsed: " << time_span.count() << std::endl;
 
 
-  std::cout << sandpile.nodes[0][0]->height << " grains of sand" << std::endl;
+  std::cout << sandpile.height(0, 0) << " grains of sand" << std::endl;
   t1 = high_resolution_clock::now();
 
   sandpile.stabilizeWithChaining();
@@ -129,12 +138,19 @@ int main(void) {
 
   t1 = high_resolution_clock::now();
 
-  draw(sandpile, width);
+  ThreadPool painters(default_thread_count());
+  write_image("out.png", width, nodeRows(sandpile), painters);
 
   t2 = high_resolution_clock::now();
   time_span = duration_cast<duration<double>>(t2 - t1);
 
   std::cout << "painting done.  Time elapsed: " << time_span.count() << std::endl;
 
+#ifdef USE_SDL
+  std::vector<std::uint32_t> pixels =
+      render_image(width, nodeRows(sandpile), painters);
+  view(pixels, 2 * width - 1);
+#endif
+
 
 }
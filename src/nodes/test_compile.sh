@@ -0,0 +1 @@
+g++ -O2 -std=c++17 -pthread test_pile.cpp pile.cpp -o test_pile
@@ -0,0 +1,48 @@
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include "pile.h"
+
+static int failures = 0;
+
+static void check(bool ok, const std::string &what)
+{
+  std::cout << (ok ? "ok   " : "FAIL ") << what << std::endl;
+  if (!ok) failures++;
+}
+
+static bool sameHeights(pile &a, pile &b)
+{
+  for (int i = 0; i < a.N; i++) {
+    for (int j = 0; j <= i; j++) {
+      if (a.height(i, j) != b.height(i, j)) return false;
+    }
+  }
+  return true;
+}
+
+// the warm start only skips topplings: both end on the same stable pile
+static void testWarmStartMatchesColdStart()
+{
+  const int width = 150;
+  for (long grains : {1000L, 20000L, 1L << 17}) {
+    for (const char *density : {"3", "3.5"}) {
+      pile cold(width), warm(width);
+      cold.height(0, 0) = grains;
+      warm.height(0, 0) = grains;
+      cold.stabilizeWithChaining();
+      long skipped = warm.warmStart(std::atof(density));
+      warm.stabilizeWithChaining();
+      check(sameHeights(cold, warm) && skipped > 0,
+            "warm start at density " + std::string(density) + " with " +
+            std::to_string(grains) + " grains matches cold start");
+    }
+  }
+}
+
+int main()
+{
+  testWarmStartMatchesColdStart();
+  std::cout << failures << " failures" << std::endl;
+  return failures != 0;
+}
@@ -129,6 +129,14 @@ class RectGrid:
         return [self.permutation_symmetries(format=format)] + \
             self.mirror_symmetries(format=format)
 
+    def red_black(self):
+        '''
+        checkerboard coloring by the parity of the coordinate sum, no two
+        neighbours share a color
+        '''
+        index = np.indices((self.n,) * self.n_dimensions)
+        return (np.sum(index, axis=0).reshape(-1) % 2).astype(np.int32)
+
     def eye(self):
         N = self.n ** self.n_dimensions
         return eye(N, dtype=np.int8)
@@ -203,11 +211,35 @@ def duplicate_non_ones(mat):
     indptr = np.cumsum(np.sum(np.pad(mat.toarray(), pad_width=(1,0)), axis=0))
     return csr_array((data, indices, indptr), mat.shape)
 
+def greedy_coloring(operator):
+    '''
+    coloring of any operator, symmetry folded ones included: rows linked
+    either way round get different colors
+    '''
+    pattern = (abs(operator) + abs(operator).T).tocsr()
+    return _greedy_coloring(
+        pattern.indices.astype(np.int32),
+        pattern.indptr.astype(np.int32),
+    )
+
+def color_classes(colors):
+    '''
+    rows sorted by color and the offsets of each color's run in that order
+    '''
+    order = np.argsort(colors, kind='stable').astype(np.int32)
+    color_ptr = np.searchsorted(colors[order], np.arange(np.max(colors) + 2))
+    return order, color_ptr.astype(np.int32)
+
 from itertools import chain
 use_cython = True
 if use_cython:
-    from stabilize import _stabilize
-    def stabilize(pile, laplacian, degree=4, initial_spills=None, completion_check=1):
+    from stabilize import _stabilize, _stabilize_colored, _greedy_coloring
+    def stabilize(pile, laplacian, degree=4, initial_spills=None, completion_check=1,
+                  coloring=None, threads=0):
+        '''
+        with a coloring of laplacian the color classes are toppled in
+        parallel on threads threads, 0 for as many as OpenMP likes
+        '''
         laplacian = laplacian.tocsc()
         laplacian.setdiag(0, k=0)
         laplacian.eliminate_zeros()
@@ -215,7 +247,16 @@ if use_cython:
         #laplacian = duplicate_non_ones(laplacian)
         print(sum(laplacian.data > 1) / len(laplacian.data), 'fraction non one elements in data')
         t0 = time.time()
-        iterations = _stabilize(pile, laplacian.data, laplacian.indices, laplacian.indptr)
+        if coloring is None:
+            iterations = _stabilize(pile, laplacian.data, laplacian.indices,
+                                    laplacian.indptr, degree=int(np.max(degree)))
+        else:
+            order, color_ptr = color_classes(coloring)
+            rows = laplacian.tocsr()
+            iterations = _stabilize_colored(
+                pile, rows.data, rows.indices, rows.indptr,
+                order, color_ptr, degree=int(np.max(degree)), num_threads=threads
+            )
         t1 = time.time()
         print('stabilization alone took', t1-t0)
         print(iterations, 'iterations')
@@ -223,7 +264,8 @@ if use_cython:
         print((t1-t0)/iterations/len(pile), 's per inner loop executions')
         return pile, 0*pile
 else:
-    def stabilize(pile, laplacian, degree=4, initial_spills=None, completion_check=1):
+    def stabilize(pile, laplacian, degree=4, initial_spills=None, completion_check=1,
+                  coloring=None, threads=0):
         if initial_spills is None:
             spills = 0 * pile
         else:
@@ -261,6 +303,8 @@ def sandpile(
     use_symmetry=True,
     initial_guess=False,
     completion_check=1,
+    threads=1,
+    engine='sparse',
 ):
     R = (N / unit_n_ball_volume(n_dimensions)) ** (1 / n_dimensions)
     print('R', R)
@@ -271,6 +315,11 @@ def sandpile(
     print('outer R', Router)
     n = 2*int(Router) + 1
     print('n', n)
+    if engine == 'lattice':
+        return lattice_sandpile(N, n_dimensions, n, threads)
+    if engine == 'pile':
+        assert n_dimensions == 2, 'the octant engine is for the plane'
+        return grid_sandpile(N, n, threads)
     grid = RectGrid(n, n_dimensions)
 
     pile = np.zeros(grid.r.shape, dtype=int)
@@ -316,6 +365,11 @@ def sandpile(
         pile += spillover
    
     pile = pile.astype(np.int8)
+    # more than one thread topples color classes in parallel: red-black on
+    # the plain lattice, greedy once the operator is folded
+    coloring = None
+    if threads != 1:
+        coloring = greedy_coloring(laplacian) if use_symmetry else grid.red_black()
     print('format', laplacian.format)
     print('pile dtype', pile.dtype)
     print('laplacian dtype', laplacian.dtype)
@@ -327,7 +381,9 @@ def sandpile(
         laplacian,
         initial_spills=spills0,
         degree=degree,
-        completion_check=completion_check
+        completion_check=completion_check,
+        coloring=coloring,
+        threads=threads,
     )
 
     if use_symmetry:
@@ -343,6 +399,53 @@ def sandpile(
 
 
 
+def lattice_sandpile(N, n_dimensions, n, threads=1):
+    '''
+    sandpile() on the native engine of src/lattice: no sparse operators,
+    the pile is kept on the symmetry wedge and only the plane through the
+    first two axes is ever unfolded
+    '''
+    from lattice import LatticePile
+    t0 = time.time()
+    # the same box as RectGrid(n), its surface the sink
+    pile = LatticePile(n_dimensions, (n + 1) // 2 + 1)
+    pile.add([0] * n_dimensions, N)
+    sweeps = pile.stabilize(threads=threads)
+    t1 = time.time()
+    print('stabilization took', t1-t0)
+    print(sweeps, 'sweeps')
+    print('chip accounting', pile.grains() - N)
+
+    plane = pile.plane()
+    w = pile.width - 1
+    plt.imshow(plane, extent=(-w, w, -w, w))
+    plt.show()
+    return pile
+
+
+def grid_sandpile(N, n, threads=1):
+    '''
+    sandpile() in two dimensions on the octant engine of src/grid, the
+    cells read straight out of the pile
+    '''
+    from gridpile import GridPile
+    t0 = time.time()
+    # the same box as RectGrid(n), its rim the sink
+    pile = GridPile((n + 1) // 2 + 1)
+    pile.add_grains(N)
+    sweeps = pile.stabilize(threads=threads)
+    t1 = time.time()
+    print('stabilization took', t1-t0)
+    print(sweeps, 'sweeps')
+    print('chip accounting', pile.grains() - N)
+
+    plane = pile.plane()
+    w = pile.width - 1
+    plt.imshow(plane, extent=(-w, w, -w, w))
+    plt.show()
+    return pile
+
+
 if __name__ == "__main__":
     sandpile(
         2**18,
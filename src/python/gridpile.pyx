@@ -0,0 +1,245 @@
+# distutils: language = c++
+import numpy as np
+cimport numpy as np
+cimport cython
+from cpython.buffer cimport PyBUF_FORMAT
+from libc.stdint cimport uint32_t, uint64_t
+from libcpp cimport bool as cbool
+from libcpp.string cimport string
+from libcpp.vector cimport vector
+
+cdef extern from "../grid/pool.h":
+    cdef cppclass ThreadPool:
+        ThreadPool(int num_threads) except +
+    int default_thread_count()
+
+cdef extern from "../grid/kernel.h":
+    ctypedef void *run_kernel
+    run_kernel kernel_by_name(const string &name)
+    const char *kernel_name(run_kernel kernel)
+
+cdef extern from "../grid/octant.h":
+    ctypedef unsigned int cell_t
+    cdef cppclass octant:
+        int width
+        int capacity
+        vector[size_t] offsets
+        cell_t *cells
+        int length(int i)
+
+cdef extern from "../grid/pile.h":
+    cdef cppclass grid_pile "pile":
+        octant nodes
+        run_kernel kernel
+        uint64_t reservoir
+        uint64_t sweeps
+        cbool sliced_tail
+        grid_pile(int N, int capacity) except +
+        int stabilize(int num_threads) nogil
+        int stabilize_bands(ThreadPool &pool) nogil
+        int stabilize_tiles(ThreadPool &pool) nogil
+        int stabilize_processes(int num_processes) nogil
+        void add_grains(uint64_t grains)
+        void cover_grains()
+
+
+cdef class GridPile:
+    '''
+    The octant engine of src/grid on the square lattice, see src/grid/pile.h.
+    Cell (i, j) of the octant is plane point (j, i + j), its last cell
+    j = width - 1 - i the sink.  The pile is its own NumPy buffer: a flat
+    uint32 array over every column the pile may grow into, column i at
+    offsets[i], written and read in place with no copy.
+    '''
+    cdef grid_pile *sandpile
+    cdef Py_ssize_t shape[1]
+    cdef Py_ssize_t strides[1]
+
+    def __cinit__(self, int width, int capacity=0):
+        if width < 4:
+            raise ValueError('width must be at least 4')
+        self.sandpile = new grid_pile(width, capacity)
+
+    def __dealloc__(self):
+        del self.sandpile
+
+    def __getbuffer__(self, Py_buffer *buffer, int flags):
+        # the cells stay where they are as the pile grows, so a view is
+        # good for as long as the pile lives
+        self.shape[0] = self.sandpile.nodes.offsets[self.sandpile.nodes.capacity]
+        self.strides[0] = sizeof(cell_t)
+        buffer.buf = self.sandpile.nodes.cells
+        buffer.obj = self
+        buffer.len = self.shape[0] * sizeof(cell_t)
+        buffer.itemsize = sizeof(cell_t)
+        buffer.readonly = 0
+        buffer.format = NULL
+        if flags & PyBUF_FORMAT:
+            buffer.format = b'I'
+        buffer.ndim = 1
+        buffer.shape = self.shape
+        buffer.strides = self.strides
+        buffer.suboffsets = NULL
+        buffer.internal = NULL
+
+    def __releasebuffer__(self, Py_buffer *buffer):
+        pass
+
+    @property
+    def width(self):
+        return self.sandpile.nodes.width
+
+    @property
+    def capacity(self):
+        return self.sandpile.nodes.capacity
+
+    @property
+    def offsets(self):
+        '''first cell of every column in the buffer, and the end of the last'''
+        return np.array(self.sandpile.nodes.offsets[:self.sandpile.nodes.width + 1], dtype=np.intp)
+
+    @property
+    def sweeps(self):
+        return self.sandpile.sweeps
+
+    @property
+    def reservoir(self):
+        '''grains still held back at the source'''
+        return self.sandpile.reservoir
+
+    @property
+    def kernel(self):
+        return kernel_name(self.sandpile.kernel).decode()
+
+    @kernel.setter
+    def kernel(self, name):
+        cdef run_kernel kernel = kernel_by_name(name.encode())
+        if kernel == NULL:
+            raise ValueError('kernel {} not available'.format(name))
+        self.sandpile.kernel = kernel
+
+    @property
+    def sliced_tail(self):
+        return self.sandpile.sliced_tail
+
+    @sliced_tail.setter
+    def sliced_tail(self, value):
+        self.sandpile.sliced_tail = value
+
+    def column(self, int i):
+        '''column i of the octant, a view into the pile'''
+        if not 0 <= i < self.sandpile.nodes.width:
+            raise IndexError('column outside the octant')
+        start = self.sandpile.nodes.offsets[i]
+        return np.asarray(self)[start:start + self.sandpile.nodes.length(i)]
+
+    def add_grains(self, uint64_t grains):
+        '''drops grains at the origin, past 2^30 into the reservoir'''
+        self.sandpile.add_grains(grains)
+
+    @cython.boundscheck(False)
+    @cython.wraparound(False)
+    def seed(self, heights):
+        '''
+        Sets every cell from heights, either the octant as a width by width
+        array indexed (i, j), cells past the sink ignored, or the plane as
+        a 2 width - 1 square, origin in the middle, of which only the
+        octant is read.
+        '''
+        cdef int w = self.sandpile.nodes.width
+        cdef int i, j
+        heights = np.asarray(heights)
+        if heights.shape != (w, w) and heights.shape != (2*w - 1, 2*w - 1):
+            raise ValueError('heights must be {0} by {0} or {1} by {1}'.format(w, 2*w - 1))
+        if heights.size and (heights.min() < 0 or heights.max() > 0xffffffff):
+            raise ValueError('heights must fit in 32 bits')
+        cdef np.ndarray[np.uint32_t, ndim=2] cells = heights.astype(np.uint32)
+        cdef bint plane = heights.shape[0] != w
+        cdef cell_t *column
+        for i in range(w):
+            column = self.sandpile.nodes.cells + self.sandpile.nodes.offsets[i]
+            for j in range(w - i):
+                if plane:
+                    column[j] = cells[w - 1 + i + j, w - 1 + j]
+                else:
+                    column[j] = cells[i, j]
+        self.sandpile.cover_grains()
+
+    def stabilize(self, int threads=0, engine='chain'):
+        '''
+        Topples until stable without the GIL on threads threads, 0 for one
+        per core, by the chain, bands, tiles or processes engine.  Cells
+        written through the buffer are picked up first.
+        '''
+        if engine not in ('chain', 'bands', 'tiles', 'processes'):
+            raise ValueError('unknown engine {}'.format(engine))
+        if threads <= 0:
+            threads = default_thread_count()
+        self.sandpile.cover_grains()
+        cdef ThreadPool *pool = NULL
+        cdef int count
+        if engine == 'chain':
+            with nogil:
+                count = self.sandpile.stabilize(threads)
+        elif engine == 'processes':
+            with nogil:
+                count = self.sandpile.stabilize_processes(threads)
+            if count < 0:
+                raise RuntimeError('a worker process failed')
+        else:
+            pool = new ThreadPool(threads)
+            try:
+                if engine == 'bands':
+                    with nogil:
+                        count = self.sandpile.stabilize_bands(pool[0])
+                else:
+                    with nogil:
+                        count = self.sandpile.stabilize_tiles(pool[0])
+            finally:
+                del pool
+        return count
+
+    @cython.boundscheck(False)
+    @cython.wraparound(False)
+    def octant(self):
+        '''a copy of the octant as a width by width array indexed (i, j)'''
+        cdef int w = self.sandpile.nodes.width
+        cdef int i, j
+        cdef cell_t *column
+        cdef np.ndarray[np.uint32_t, ndim=2] out = np.zeros((w, w), dtype=np.uint32)
+        for i in range(w):
+            column = self.sandpile.nodes.cells + self.sandpile.nodes.offsets[i]
+            for j in range(w - i):
+                out[i, j] = column[j]
+        return out
+
+    @cython.boundscheck(False)
+    @cython.wraparound(False)
+    def plane(self):
+        '''a copy of the whole plane, 2 width - 1 square, origin in the middle'''
+        cdef int w = self.sandpile.nodes.width
+        cdef int x, y, ax, ay
+        cdef cell_t height
+        cdef np.ndarray[np.uint32_t, ndim=2] out = np.empty((2*w - 1, 2*w - 1), dtype=np.uint32)
+        for y in range(2*w - 1):
+            ay = abs(y - (w - 1))
+            for x in range(2*w - 1):
+                ax = abs(x - (w - 1))
+                # (ax, ay) folds to (i, j) = (ay - ax, ax) above the
+                # diagonal and to (ax - ay, ay) below it
+                if ax <= ay:
+                    height = self.sandpile.nodes.cells[self.sandpile.nodes.offsets[ay - ax] + ax]
+                else:
+                    height = self.sandpile.nodes.cells[self.sandpile.nodes.offsets[ax - ay] + ay]
+                out[y, x] = height
+        return out
+
+    def grains(self):
+        '''grains on the plane, the reservoir and the sink's included'''
+        cells = self.octant()
+        w = self.sandpile.nodes.width
+        i, j = np.indices((w, w))
+        # the origin once, the folds i = 0 and j = 0 four times, the rest eight
+        multiplicity = np.where((i == 0) & (j == 0), 1,
+                                np.where((i == 0) | (j == 0), 4, 8))
+        return int(np.sum(cells.astype(np.uint64) * multiplicity)) + self.sandpile.reservoir
@@ -0,0 +1,122 @@
+# distutils: language = c++
+import numpy as np
+cimport numpy as np
+cimport cython
+from libc.stdint cimport uint32_t, uint64_t
+from libcpp.vector cimport vector
+
+cdef extern from "../grid/pool.h":
+    cdef cppclass ThreadPool:
+        ThreadPool(int num_threads) except +
+    int default_thread_count()
+
+cdef extern from "../lattice/lattice.h":
+    cdef cppclass lattice_pile:
+        int dimensions
+        int width
+        vector[uint32_t] heights
+        uint64_t sweeps
+        lattice_pile(int dimensions, int width) except +
+        size_t size()
+        uint32_t *find(const int *x)
+        uint64_t grains()
+        int stabilize(ThreadPool &pool) nogil
+
+
+cdef class LatticePile:
+    '''
+    Native sandpile on the cubic lattice in any dimension up to 8, held on
+    the fundamental domain of its symmetries, see src/lattice/lattice.h.
+    The box |x_k| < width is the pile, the surface |x_k| = width - 1 the
+    sink.  Points are addressed by their full lattice coordinates.
+    '''
+    cdef lattice_pile *pile
+
+    def __cinit__(self, int dimensions, int width):
+        if not 1 <= dimensions <= 8:
+            raise ValueError('dimensions must be 1 to 8')
+        if width < 2:
+            raise ValueError('width must be at least 2')
+        self.pile = new lattice_pile(dimensions, width)
+
+    def __dealloc__(self):
+        del self.pile
+
+    @property
+    def dimensions(self):
+        return self.pile.dimensions
+
+    @property
+    def width(self):
+        return self.pile.width
+
+    @property
+    def sweeps(self):
+        return self.pile.sweeps
+
+    def __len__(self):
+        return self.pile.size()
+
+    cdef uint32_t *_find(self, point) except? NULL:
+        cdef int x[8]
+        if len(point) != self.pile.dimensions:
+            raise ValueError('point needs {} coordinates'.format(self.pile.dimensions))
+        for k in range(self.pile.dimensions):
+            x[k] = point[k]
+        return self.pile.find(x)
+
+    def add(self, point, grains):
+        '''drops grains on point, and on every point of its orbit'''
+        cdef uint32_t *cell = self._find(point)
+        if cell == NULL:
+            raise IndexError('point outside the pile')
+        cell[0] += grains
+
+    def height(self, point):
+        cdef uint32_t *cell = self._find(point)
+        return 0 if cell == NULL else cell[0]
+
+    def heights(self):
+        '''a copy of the domain's heights in rank order'''
+        cdef np.ndarray[np.uint32_t, ndim=1] out = np.empty(self.pile.size(), dtype=np.uint32)
+        cdef size_t r
+        for r in range(self.pile.size()):
+            out[r] = self.pile.heights[r]
+        return out
+
+    def grains(self):
+        '''grains on the pile, those lost to the sink not counted'''
+        return self.pile.grains()
+
+    def stabilize(self, int threads=0):
+        '''topples until stable on threads threads, 0 for one per core'''
+        cdef ThreadPool *pool = new ThreadPool(
+            threads if threads > 0 else default_thread_count())
+        cdef int count
+        try:
+            with nogil:
+                count = self.pile.stabilize(pool[0])
+        finally:
+            del pool
+        return count
+
+    def plane(self):
+        '''the heights on the plane through the first two axes'''
+        cdef int w = self.pile.width
+        cdef int x[8]
+        cdef int a, b, k
+        cdef uint32_t *cell
+        cdef np.ndarray[np.uint32_t, ndim=2] out = np.zeros((2*w - 1, 2*w - 1), dtype=np.uint32)
+        for k in range(self.pile.dimensions):
+            x[k] = 0
+        for a in range(-(w - 1), w):
+            for b in range(-(w - 1), w):
+                x[0] = a
+                if self.pile.dimensions > 1:
+                    x[1] = b
+                elif b != 0:
+                    continue
+                cell = self.pile.find(x)
+                if cell != NULL:
+                    out[a + w - 1, b + w - 1] = cell[0]
+        return out
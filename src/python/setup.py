@@ -15,7 +15,31 @@ setup(
             'stabilize',
             ['stabilize.pyx'],
             include_dirs=[numpy.get_include()],
-        )
+            extra_compile_args=['-fopenmp'],
+            extra_link_args=['-fopenmp'],
+        ),
+        # the native lattice engine of src/lattice
+        Extension(
+            'lattice',
+            ['lattice.pyx', '../lattice/lattice.cpp', '../grid/pool.cpp'],
+            include_dirs=[numpy.get_include()],
+            language='c++',
+            extra_compile_args=['-std=c++17', '-pthread'],
+            extra_link_args=['-pthread'],
+        ),
+        # the octant engine of src/grid
+        Extension(
+            'gridpile',
+            ['gridpile.pyx'] + ['../grid/' + name for name in [
+                'pile.cpp', 'tiles.cpp', 'procs.cpp', 'sliced.cpp', 'octant.cpp',
+                'kernel.cpp', 'pool.cpp', 'telemetry.cpp', 'snapshot.cpp',
+                'frames.cpp', 'render.cpp', 'profile.cpp',
+            ]],
+            include_dirs=[numpy.get_include()],
+            language='c++',
+            extra_compile_args=['-std=c++17', '-pthread'],
+            extra_link_args=['-pthread'],
+        ),
     ],
     cmdclass={'build_ext': build_ext}
 )
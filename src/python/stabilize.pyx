@@ -1,19 +1,33 @@
 import numpy as np
 cimport numpy as np
 cimport cython
+from cython.parallel cimport prange
+
+# int8 is enough once the pile is near stable, unpacked piles with all
+# grains at the origin need the wider types
+ctypedef fused height_t:
+    np.int8_t
+    np.int32_t
+    np.int64_t
 
 
 @cython.boundscheck(False)  # Deactivate bounds checking
 @cython.wraparound(False)   # Deactivate negative indexing.
 @cython.cdivision(True)
 def _stabilize(
-    np.int8_t[::1] pile,
+    height_t[::1] pile,
     np.int8_t[::1] data,
     np.int32_t[::1] indices,
     np.int32_t[::1] indptr,
+    int degree=4,
 ):
+    '''
+    Topples every row i with pile[i] >= degree, handing each of its links
+    data[j] grains per toppling, until none is left.  The operator comes by
+    columns, CSC, so row i's links are indptr[i] <= j < indptr[i+1].
+    '''
     cdef Py_ssize_t i, j = 0
-    cdef np.int8_t spill
+    cdef height_t spill
     cdef int done = 0
     cdef int iterations = 0
 
@@ -21,12 +35,95 @@ def _stabilize(
         done = 1
         iterations += 1
         for i in range(indptr.shape[0]-1):
-            if pile[i] >= 4:
-                spill = pile[i] >> 2
-                pile[i] = pile[i] & 3
+            if pile[i] >= degree:
+                spill = pile[i] // degree
+                pile[i] = pile[i] % degree
                 for j in range(indptr[i], indptr[i+1]):
                     pile[indices[j]] += spill * data[j]
                 done = 0
     return iterations
 
 
+
+@cython.boundscheck(False)
+@cython.wraparound(False)
+@cython.cdivision(True)
+def _stabilize_colored(
+    height_t[::1] pile,
+    np.int8_t[::1] data,
+    np.int32_t[::1] indices,
+    np.int32_t[::1] indptr,
+    np.int32_t[::1] order,
+    np.int32_t[::1] color_ptr,
+    int degree=4,
+    int num_threads=0,
+):
+    '''
+    Parallel _stabilize over a coloring, with the GIL released.  The rows
+    are visited one color class at a time, order[color_ptr[c]:color_ptr[c+1]]
+    being the rows of color c, and a class is spread over OpenMP threads.
+    The operator comes by rows, CSR, and a row pulls in what its neighbours
+    spilled since its last visit before toppling, so no two threads ever
+    write the same height.  No two linked rows may share a color.
+    num_threads 0 leaves the count to OpenMP.
+    '''
+    cdef Py_ssize_t c, k, i, j, first, last
+    cdef height_t height
+    cdef long changed = 1
+    cdef int iterations = 0
+    # what each row spilled, per link, the last time its color came round
+    spilled_array = np.zeros(pile.shape[0], dtype=np.asarray(pile).dtype)
+    cdef height_t[::1] spilled = spilled_array
+
+    with nogil:
+        while changed:
+            changed = 0
+            iterations += 1
+            for c in range(color_ptr.shape[0]-1):
+                first = color_ptr[c]
+                last = color_ptr[c+1]
+                for k in prange(first, last, schedule='static',
+                                num_threads=num_threads):
+                    i = order[k]
+                    height = pile[i]
+                    for j in range(indptr[i], indptr[i+1]):
+                        height = height + spilled[indices[j]] * data[j]
+                    if height >= degree:
+                        spilled[i] = height // degree
+                        pile[i] = height % degree
+                        changed += 1
+                    else:
+                        spilled[i] = 0
+                        pile[i] = height
+    return iterations
+
+
+@cython.boundscheck(False)
+@cython.wraparound(False)
+def _greedy_coloring(
+    np.int32_t[::1] indices,
+    np.int32_t[::1] indptr,
+):
+    '''
+    First fit coloring of a symmetric sparsity pattern in row order.
+    Returns the color of every row, no two linked rows sharing one.
+    '''
+    cdef Py_ssize_t n = indptr.shape[0] - 1
+    cdef Py_ssize_t i, j
+    cdef int c
+    colors_array = np.full(n, -1, dtype=np.int32)
+    # taken[c] == i marks color c as used by a neighbour of row i
+    taken_array = np.full(n + 1, -1, dtype=np.intp)
+    cdef np.int32_t[::1] colors = colors_array
+    cdef Py_ssize_t[::1] taken = taken_array
+
+    with nogil:
+        for i in range(n):
+            for j in range(indptr[i], indptr[i+1]):
+                if indices[j] != i and colors[indices[j]] >= 0:
+                    taken[colors[indices[j]]] = i
+            c = 0
+            while taken[c] == i:
+                c += 1
+            colors[i] = c
+    return colors_array
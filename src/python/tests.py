@@ -1,5 +1,5 @@
 import unittest
-from grid import RectGrid, stabilize, unit_n_ball_volume
+from grid import RectGrid, stabilize, unit_n_ball_volume, greedy_coloring
 import numpy as np
 import scipy.sparse as sparse
 import matplotlib.pyplot as plt
@@ -12,6 +12,74 @@ class MiscTests(unittest.TestCase):
     def test_3d_ball_volume(self):
         self.assertAlmostEqual(unit_n_ball_volume(3), 4/3*np.pi)
 
+class LatticeTests(unittest.TestCase):
+    def test_lattice_matches_sparse(self):
+        from lattice import LatticePile
+        for n_dimensions in (2, 3):
+            grid = RectGrid(9, n_dimensions)
+            pile = np.zeros(grid.r.shape, dtype=int)
+            pile[grid.r == 0] = 500
+            expected, _ = stabilize(
+                pile,
+                grid.laplacian,
+                grid.degree,
+                coloring=grid.red_black(),
+            )
+            # RectGrid(9) loses grains past |x| = 4, the lattice's sink
+            lattice = LatticePile(n_dimensions, 6)
+            lattice.add([0] * n_dimensions, 500)
+            lattice.stabilize(threads=2)
+            points = np.stack(grid.X, axis=1).astype(int)
+            np.testing.assert_array_equal(
+                [lattice.height(x) for x in points],
+                expected
+            )
+            self.assertEqual(lattice.grains(), np.sum(expected))
+
+class GridPileTests(unittest.TestCase):
+    def test_grid_pile_matches_lattice(self):
+        from gridpile import GridPile
+        from lattice import LatticePile
+        # both sink at max(|x|, |y|) = width - 1
+        lattice = LatticePile(2, 30)
+        lattice.add([0, 0], 3000)
+        lattice.stabilize(threads=2)
+        for engine in ('chain', 'bands', 'tiles', 'processes'):
+            pile = GridPile(30)
+            pile.add_grains(3000)
+            pile.stabilize(threads=2, engine=engine)
+            np.testing.assert_array_equal(pile.plane(), lattice.plane())
+            self.assertEqual(pile.grains(), 3000)
+
+    def test_grid_pile_buffer_is_the_pile(self):
+        from gridpile import GridPile
+        pile = GridPile(20)
+        cells = np.asarray(pile)
+        self.assertEqual(cells.dtype, np.uint32)
+        cells[pile.offsets[0]] = 1000
+        self.assertEqual(pile.octant()[0, 0], 1000)
+        pile.stabilize(threads=1)
+        self.assertTrue(np.shares_memory(cells, pile.column(3)))
+        self.assertEqual(cells[pile.offsets[0]], pile.octant()[0, 0])
+        self.assertLess(cells.max(), 4)
+
+    def test_grid_pile_seeds_from_plane(self):
+        from gridpile import GridPile
+        rng = np.random.default_rng(3)
+        octant = rng.integers(0, 8, size=(20, 20))
+        seeded = GridPile(20)
+        seeded.seed(octant)
+        plane = seeded.plane()
+        again = GridPile(20)
+        again.seed(plane)
+        np.testing.assert_array_equal(again.octant(), seeded.octant())
+        seeded.stabilize(threads=1)
+        again.stabilize(threads=2, engine='bands')
+        np.testing.assert_array_equal(again.octant(), seeded.octant())
+        # all but the rim, the sink
+        self.assertTrue(np.all(seeded.plane()[1:-1, 1:-1] < 4))
+
+
 class RectGridTests(unittest.TestCase):
 
     def setUp(self):
@@ -158,6 +226,43 @@ class RectGridTests(unittest.TestCase):
             expand @ spills2
         )
     
+    def test_colorings_are_proper(self):
+        expand, collapse, mask = self.grid.expand_collapse_ops()
+        folded = collapse @ self.grid.laplacian @ expand
+        for laplacian, colors in (
+            (self.grid.laplacian, self.grid.red_black()),
+            (folded, greedy_coloring(folded)),
+        ):
+            links = laplacian.tocoo()
+            off_diagonal = links.row != links.col
+            self.assertFalse(np.any(
+                colors[links.row[off_diagonal]] == colors[links.col[off_diagonal]]
+            ))
+
+    def test_stabilize_colored(self):
+        pile0 = np.zeros(self.grid.r.shape, dtype=int)
+        min_r = np.min(self.grid.r)
+        pile0[self.grid.r == min_r] = 64 // sum(self.grid.r == min_r)
+        pile1, _ = stabilize(
+            pile0.copy(),
+            self.grid.laplacian,
+            self.grid.degree,
+            coloring=self.grid.red_black(),
+            threads=1,
+        )
+        pile2, _ = stabilize(
+            pile0.copy(),
+            self.grid.laplacian,
+            self.grid.degree,
+            coloring=greedy_coloring(self.grid.laplacian),
+            threads=2,
+        )
+        # the stable pile does not depend on the toppling order
+        np.testing.assert_array_equal(pile1, pile2)
+        self.assertEqual(np.sum(pile0), np.sum(pile1))
+        self.assertTrue(np.all(pile1 >= 0))
+        self.assertTrue(np.all(pile1 < self.grid.degree))
+
     def test_equivalence_of_condensed_laplacian(self):
         expand, collapse, mask = self.grid.expand_collapse_ops()
         laplacian = self.grid.laplacian